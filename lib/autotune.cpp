@@ -0,0 +1,173 @@
+#include <time.h>
+#include <math.h>
+
+#include <complex>
+#include <vector>
+
+#include "autotune.h"
+#include "qpacketframe.h"
+#include "debug.h"
+
+
+// We time at least MIN_REPS frames, and keep going until that takes
+// MIN_TIME seconds or we have done MAX_REPS frames.
+#define MIN_REPS  (3)
+#define MAX_REPS  (64)
+#define MIN_TIME  (0.001)
+
+
+static inline double cpuTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + 1.0e-9*t.tv_nsec;
+}
+
+
+extern "C" {
+
+static int nullFrameSyncCallback(unsigned char *header, int header_valid,
+        unsigned char *payload, unsigned int payload_len,
+        int payload_valid, framesyncstats_s stats, void *userdata) {
+    return 0;
+}
+
+static void nullQpacketFrameCallback(struct qpacketframe *frame,
+        void *userdata) {
+}
+} // extern "C" {
+
+
+// A frame generator for either framing, which writes frames of zeros.
+class testgen {
+
+    public:
+
+        testgen(const numerology *num, int framing,
+                const struct scheme *mode, size_t payload_len):
+            payload(payload_len, 0) {
+
+            ofdmflexframegenprops_s fgprops;
+            setFrameGenProps(&fgprops, mode);
+            if(framing == FRAMING_QPACKET)
+                qg = new qpacketframegen(num->M, num->cp_len,
+                        num->taper_len, num->p(), &fgprops);
+            else {
+                fg = ofdmflexframegen_create(num->M, num->cp_len,
+                        num->taper_len, num->p(), &fgprops);
+                ASSERT(fg, "ofdmflexframegen_create() failed");
+            }
+            packHeader(header, 0, 0);
+        }
+
+        ~testgen() {
+            if(qg) delete qg;
+            if(fg) ofdmflexframegen_destroy(fg);
+        }
+
+        // Writes a frame to x, which must have room for it.  Returns the
+        // number of samples written.
+        size_t write(std::complex<float> *x) {
+
+            if(qg)
+                qg->assemble(header, payload.data(), payload.size());
+            else
+                ofdmflexframegen_assemble(fg, header, payload.data(),
+                        payload.size());
+
+            size_t len = 0;
+            bool last_symbol = false;
+            while(!last_symbol) {
+                if(qg)
+                    last_symbol = qg->write(x + len, COMPLEX_PER_WRITE);
+                else
+                    last_symbol = ofdmflexframegen_write(fg, x + len,
+                            COMPLEX_PER_WRITE);
+                len += COMPLEX_PER_WRITE;
+            }
+            return len;
+        }
+
+    private:
+
+        ::ofdmflexframegen fg = 0;
+        qpacketframegen *qg = 0;
+        unsigned char header[HEADER_LEN];
+        std::vector<uint8_t> payload;
+};
+
+
+double timeFrameGen(const numerology *num, int framing,
+        const struct scheme *mode, size_t payload_len) {
+
+    testgen gen(num, framing, mode, payload_len);
+    std::vector<std::complex<float> > x(num->frameLength(framing, mode,
+                payload_len));
+
+    int n = 0;
+    double t, start = cpuTime();
+    do {
+        gen.write(x.data());
+        ++n;
+        t = cpuTime() - start;
+    } while(n < MAX_REPS && (n < MIN_REPS || t < MIN_TIME));
+
+    return t/n;
+}
+
+
+double timeFrameSync(const numerology *num, int framing,
+        const struct scheme *mode, size_t payload_len) {
+
+    // The frame with some quiet before and after it, so the
+    // synchronizer sees all of it like it would on the air.
+    size_t pad = 4*(num->M + num->cp_len);
+    size_t len = num->frameLength(framing, mode, payload_len);
+    std::vector<std::complex<float> > x(pad + len + pad, 0.0f);
+    {
+        testgen gen(num, framing, mode, payload_len);
+        gen.write(x.data() + pad);
+    }
+
+    ::ofdmflexframesync fs = 0;
+    qpacketframesync *qs = 0;
+    if(framing == FRAMING_QPACKET)
+        qs = new qpacketframesync(num->M, num->cp_len, num->taper_len,
+                num->p(), nullQpacketFrameCallback, 0);
+    else {
+        fs = ofdmflexframesync_create(num->M, num->cp_len, num->taper_len,
+                num->p(), nullFrameSyncCallback, 0);
+        ASSERT(fs, "ofdmflexframesync_create() failed");
+    }
+
+    int n = 0;
+    double t, start = cpuTime();
+    do {
+        if(qs) {
+            qs->execute(x.data(), x.size());
+            qs->reset();
+        } else {
+            ofdmflexframesync_execute(fs, x.data(), x.size());
+            ofdmflexframesync_reset(fs);
+        }
+        ++n;
+        t = cpuTime() - start;
+    } while(n < MAX_REPS && (n < MIN_REPS || t < MIN_TIME));
+
+    if(qs) delete qs;
+    if(fs) ofdmflexframesync_destroy(fs);
+
+    return t/n;
+}
+
+
+int autotuneBufferFrames(double frameTime) {
+
+    if(frameTime <= 0.0)
+        return AUTOTUNE_MAX_FRAMES;
+
+    double n = ceil(AUTOTUNE_BUFFER_TIME/frameTime);
+    if(n < AUTOTUNE_MIN_FRAMES) return AUTOTUNE_MIN_FRAMES;
+    if(n > AUTOTUNE_MAX_FRAMES) return AUTOTUNE_MAX_FRAMES;
+    return (int) n;
+}
@@ -0,0 +1,38 @@
+#ifndef __autotune_h__
+#define __autotune_h__
+
+#include <stddef.h>
+
+#include "numerology.h"
+#include "mcs.h"
+
+
+// Automatic tuning of the GNU Radio buffers of ofdmflexframegen and
+// ofdmflexframesync.  The blocks measure how long a full size frame is
+// and how much CPU time it takes to make or to synchronize, and size
+// their buffers to hold a whole number of frames, enough of them to
+// cover about AUTOTUNE_BUFFER_TIME seconds of work.
+
+#define AUTOTUNE_BUFFER_TIME   (0.002)
+#define AUTOTUNE_MIN_FRAMES    (2)
+#define AUTOTUNE_MAX_FRAMES    (16)
+
+
+// Returns the thread CPU time, in seconds, that it takes to make a frame
+// with a payload_len byte payload sent with mode.
+extern double timeFrameGen(const numerology *num, int framing,
+        const struct scheme *mode, size_t payload_len);
+
+// Returns the thread CPU time, in seconds, that it takes to synchronize
+// to, and for FRAMING_FLEXFRAME also decode, a frame like that.  For
+// FRAMING_QPACKET the payload is decoded by the pipeline threads, so
+// that is not counted.
+extern double timeFrameSync(const numerology *num, int framing,
+        const struct scheme *mode, size_t payload_len);
+
+// Returns how many frames that take frameTime seconds each the buffers
+// should hold.
+extern int autotuneBufferFrames(double frameTime);
+
+
+#endif // #ifndef __autotune_h__
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+
+#include "capture.h"
+#include "debug.h"
+
+
+
+static double monotonicTime(void) {
+
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1.0e-9*t.tv_nsec;
+}
+
+
+capture::capture(const std::string &prefix, size_t len,
+        double minInterval, int numBuffers):
+    d_prefix(prefix),
+    d_len(len),
+    d_minInterval(minInterval),
+    numWritten(0),
+    lastTrigger(-1.0e9),
+    seq(0),
+    numDropped(0),
+    running(true) {
+
+    ASSERT(len > 0);
+    ASSERT(numBuffers > 0);
+
+    size_t ringLen = 1;
+    while(ringLen < 2*len) ringLen <<= 1;
+    ringMask = ringLen - 1;
+
+    ring = (std::complex<float> *) calloc(ringLen,
+            sizeof(std::complex<float>));
+    ASSERT(ring, "calloc() failed");
+
+    buffers.resize(numBuffers);
+    for(int i = 0; i < numBuffers; ++i) {
+        buffers[i].samples = (std::complex<float> *)
+            malloc(len*sizeof(std::complex<float>));
+        ASSERT(buffers[i].samples, "malloc() failed");
+        freeBuffers.push_back(&buffers[i]);
+    }
+
+    d_thread = gr::thread::thread([this]() { writer(); });
+
+    DSPEW("Capturing %zu samples to \"%s\" files", len, prefix.c_str());
+}
+
+
+capture::~capture() {
+
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        running = false;
+        d_cond.notify_one();
+    }
+    // The writer finishes writing the full buffers before it returns.
+    d_thread.join();
+
+    for(size_t i = 0; i < buffers.size(); ++i)
+        free(buffers[i].samples);
+    free(ring);
+
+    // Captures still waiting for samples are dropped.
+    numDropped += pendingBuffers.size();
+    if(numDropped)
+        INFO("%" PRIu64 " captures were dropped", numDropped);
+}
+
+
+void capture::write(const std::complex<float> *x, size_t n) {
+
+    size_t ringLen = ringMask + 1;
+
+    if(n > ringLen && pendingBuffers.empty()) {
+        // We only keep the newest samples.
+        x += n - ringLen;
+        numWritten += n - ringLen;
+        n = ringLen;
+    }
+
+    // We write at most d_len samples at a time, and finish the pending
+    // captures as their samples come in, so they are still in the ring
+    // buffer.
+    while(n) {
+
+        size_t m = n < d_len ? n : d_len;
+
+        size_t i = numWritten & ringMask;
+        size_t n1 = ringLen - i;
+        if(n1 > m) n1 = m;
+
+        memcpy(ring + i, x, n1*sizeof(*x));
+        if(n1 < m)
+            memcpy(ring, x + n1, (m - n1)*sizeof(*x));
+
+        numWritten += m;
+        x += m;
+        n -= m;
+
+        while(pendingBuffers.size() &&
+                pendingBuffers.front()->end <= numWritten) {
+            finish(pendingBuffers.front());
+            pendingBuffers.pop_front();
+        }
+    }
+}
+
+
+void capture::trigger(uint64_t frameCount, const char *reason,
+        uint64_t end) {
+
+    if(end > numWritten)
+        end = numWritten;
+    end += d_len/4;
+
+    if(end + ringMask + 1 < numWritten + d_len) {
+        // The start of the capture is gone from the ring buffer.
+        ++numDropped;
+        return;
+    }
+
+    double t = monotonicTime();
+
+    if(t - lastTrigger < d_minInterval) {
+        ++numDropped;
+        return;
+    }
+
+    struct buffer *b;
+    {
+        gr::thread::scoped_lock guard(d_mutex, boost::try_to_lock);
+        if(!guard.owns_lock() || freeBuffers.empty()) {
+            // The writer is busy.  We do not wait for it.
+            ++numDropped;
+            return;
+        }
+        b = freeBuffers.front();
+        freeBuffers.pop_front();
+    }
+
+    lastTrigger = t;
+
+    b->frameCount = frameCount;
+    b->seq = seq++;
+    b->reason = reason;
+    b->end = end;
+
+    if(end > numWritten)
+        // We wait for write() to give us the rest.
+        pendingBuffers.push_back(b);
+    else
+        finish(b);
+}
+
+
+void capture::finish(struct buffer *b) {
+
+    // Copy the d_len samples before b->end out of the ring buffer, which
+    // may be in two pieces.  If we have not seen d_len samples yet the
+    // start of the capture is zeros.
+    size_t ringLen = ringMask + 1;
+    size_t i = (b->end - d_len) & ringMask;
+    size_t n1 = ringLen - i;
+    if(n1 > d_len) n1 = d_len;
+    memcpy(b->samples, ring + i, n1*sizeof(*ring));
+    if(n1 < d_len)
+        memcpy(b->samples + n1, ring, (d_len - n1)*sizeof(*ring));
+
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        fullBuffers.push_back(b);
+        d_cond.notify_one();
+    }
+}
+
+
+void capture::writer(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    while(running || fullBuffers.size()) {
+
+        if(fullBuffers.empty()) {
+            d_cond.wait(guard);
+            continue;
+        }
+
+        struct buffer *b = fullBuffers.front();
+        fullBuffers.pop_front();
+
+        // Write the file without the mutex held, so trigger() can go on.
+        guard.unlock();
+
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s_%06" PRIu64 "_f%" PRIu64 "_%s.cf32",
+                d_prefix.c_str(), b->seq, b->frameCount, b->reason);
+
+        FILE *file = fopen(path, "w");
+        if(file) {
+            if(fwrite(b->samples, sizeof(*b->samples), d_len, file)
+                    != d_len)
+                ERROR("writing \"%s\" failed", path);
+            fclose(file);
+        } else
+            ERROR("fopen(\"%s\") failed", path);
+
+        guard.lock();
+        freeBuffers.push_back(b);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef __capture_h__
+#define __capture_h__
+
+#include <stdint.h>
+
+#include <complex>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <gnuradio/thread/thread.h>
+
+
+// capture keeps a ring buffer of the most recent input samples of a
+// synchronizer, and writes len samples around a frame to a file when
+// trigger() is called.  The capture ends len/4 samples after the end of
+// the frame, so if those are not written yet it is finished by a later
+// write().  The files are written by a background thread, so write()
+// and trigger() never wait for disk I/O.  trigger() drops the capture if
+// all the capture buffers are in use, or if the last capture was less
+// than minInterval seconds ago.
+//
+// The files are raw complex float 32, like a GNU radio file sink, named:
+//
+//     PREFIX_SEQ_fFRAME_COUNT_REASON.cf32
+//
+class capture {
+
+    public:
+
+        capture(const std::string &prefix, size_t len,
+                double minInterval, int numBuffers = 4);
+        ~capture();
+
+        // Add samples to the ring buffer.
+        void write(const std::complex<float> *x, size_t n);
+
+        // The number of samples written, which is the sample number of
+        // the next sample.
+        uint64_t numSamples(void) const { return numWritten; }
+
+        size_t length(void) const { return d_len; }
+
+        // Capture the samples around a frame that ended before sample
+        // number end.  reason is a short string that we put in the file
+        // name.
+        void trigger(uint64_t frameCount, const char *reason,
+                uint64_t end);
+
+    private:
+
+        struct buffer {
+            std::complex<float> *samples;
+            uint64_t frameCount;
+            uint64_t seq;
+            const char *reason;
+            // The sample number after the last sample of the capture.
+            uint64_t end;
+        };
+
+        void writer(void);
+
+        // Copy the samples of b out of the ring buffer and queue b for
+        // the writer.
+        void finish(struct buffer *b);
+
+        std::string d_prefix;
+        size_t d_len;
+        double d_minInterval;
+
+        // The ring buffer, which is a power of 2 long so we can wrap the
+        // index with a mask.  It is at least 2 len long, so a capture
+        // that ends in the last len samples written is all in it.
+        std::complex<float> *ring;
+        size_t ringMask;
+        uint64_t numWritten;
+
+        // Triggered captures that wait for the samples after the frame,
+        // oldest first.  Only write() and trigger() use this.
+        std::deque<struct buffer *> pendingBuffers;
+
+        double lastTrigger;
+        uint64_t seq;
+        uint64_t numDropped;
+
+        // Buffers are moved between the free and full lists with the
+        // mutex held; the samples are copied without it.
+        gr::thread::mutex d_mutex;
+        gr::thread::condition_variable d_cond;
+        std::vector<struct buffer> buffers;
+        std::deque<struct buffer *> freeBuffers;
+        std::deque<struct buffer *> fullBuffers;
+        bool running;
+
+        gr::thread::thread d_thread;
+};
+
+
+#endif // #ifndef __capture_h__
@@ -1,6 +1,70 @@
+#ifndef __common_h__
+#define __common_h__
+
+#include <stdint.h>
+
 
 #define NUM_SUBCARRIERS (64)
 #define CP_LEN  (16)
 #define TAPER_LEN (4)
 
+// We write frames with ofdmflexframegen_write() this many samples at a
+// time, so frames are always a multiple of this long.
+#define COMPLEX_PER_WRITE  (8)
+
+
+// Frame formats.  FRAMING_FLEXFRAME is liquid's ofdmflexframe.
+// FRAMING_QPACKET is our qpacketframe; see qpacketframe.h.
+#define FRAMING_FLEXFRAME  (0)
+#define FRAMING_QPACKET    (1)
+
+
+// What ofdmflexframesync writes.  OUTPUT_BYTES is the decoded payloads.
+// OUTPUT_LLR_FLOAT and OUTPUT_LLR_INT8 are the LLRs of the encoded
+// payload bits of each frame, for a decoder downstream; see llr.h.
+// OUTPUT_FRAMES is one output item, a byte vector, for each payload.
+#define OUTPUT_BYTES      (0)
+#define OUTPUT_LLR_FLOAT  (1)
+#define OUTPUT_LLR_INT8   (2)
+#define OUTPUT_FRAMES     (3)
+
+
+// Liquid-DSP gives us an 8 byte user header in every frame.  The lower 7
+// bytes are a little endian frame counter and the top byte is the stream
+// ID, which lets one modem pair carry MAX_STREAMS logical streams.  A
+// frame sent with stream ID 0 has the same header as the old uint64_t
+// frame counter that we used to send.
+#define HEADER_LEN   (8)
+#define MAX_STREAMS  (256)
+
+// The frame count of the frames that ofdmflexframegen sends with a
+// frozen header, from set_frame_cache().  They all have the same header,
+// so the synchronizer does not drop them as HARQ repeats of each other
+// or combine them.
+#define FROZEN_FRAME_COUNT  ((((uint64_t) 1) << (8*(HEADER_LEN - 1))) - 1)
+
+
+static inline void packHeader(unsigned char *header,
+        uint64_t frameCount, uint32_t streamId) {
+
+    for(int i = 0; i < HEADER_LEN - 1; ++i)
+        header[i] = (frameCount >> (8*i)) & 0xFF;
+    header[HEADER_LEN - 1] = streamId & 0xFF;
+}
+
+
+static inline uint64_t getHeaderFrameCount(const unsigned char *header) {
+
+    uint64_t frameCount = 0;
+    for(int i = 0; i < HEADER_LEN - 1; ++i)
+        frameCount |= ((uint64_t) header[i]) << (8*i);
+    return frameCount;
+}
+
+
+static inline uint32_t getHeaderStreamId(const unsigned char *header) {
+
+    return header[HEADER_LEN - 1];
+}
 
+#endif // #ifndef __common_h__
@@ -3,9 +3,11 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <sys/syscall.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 
 #ifndef SYS_gettid
@@ -61,7 +63,11 @@
 
 // LEVEL maybe debug, info, notice, warn, error, and
 // off which translates to: 5, 4, 3, 2, 1, and 0
-static int spewLevel = COMPILED_SPEW_LEVEL;
+static atomic_int spewLevel = COMPILED_SPEW_LEVEL;
+
+
+static pthread_once_t spewOnce = PTHREAD_ONCE_INIT;
+static void spewInit(void);
 
 
 int qsGetLibSpewLevel(void) {
@@ -73,9 +79,10 @@ int qsGetLibSpewLevel(void) {
 // This is where the user of libquickstream can quiet down the code in the
 // library, assuming that the library was not quiet already.
 void qsSetSpewLevel(int level) {
+    pthread_once(&spewOnce, spewInit);
     if(level > 5) level = 5;
     else if(level < 0) level = 0;
-    spewLevel = level;
+    atomic_store_explicit(&spewLevel, level, memory_order_relaxed);
     //DSPEW("Spew level set to %d", level);
 }
 
@@ -84,6 +91,272 @@ void qsSetSpewLevel(int level) {
 #define BUFLEN  1024
 
 
+///////////////////////////////////////////////////////////////////////////
+// Asynchronous spew
+//
+// So that a thread that is streaming samples never waits on a terminal
+// or journald, qs_spew() does not write to the stream.  It copies the
+// line into a ring buffer that belongs to the calling thread, and a
+// background thread writes the lines out.  Each ring has one writer, the
+// thread that owns it, and one reader, whoever holds drainMutex, so the
+// spewing threads never take a lock, unless the background thread is
+// waiting for lines and they have to wake it.  If a ring is full the
+// line is dropped, and we spew how many were dropped later.
+//
+// Environment variables, read at the first spew:
+//
+//   LIQUIDDSP_SPEW_LEVEL  debug, info, notice, warn, error, off, or 5 to
+//                         0.  The default is the compiled spew level.
+//
+//   LIQUIDDSP_SPEW_SYNC   if set to 1, spew is written by the spewing
+//                         thread, like in the old days.
+//
+#define RING_LEN  256 // lines per thread, a power of 2
+
+
+struct spewLine {
+    FILE *stream;
+    char text[BUFLEN];
+};
+
+
+struct spewRing {
+    struct spewLine lines[RING_LEN];
+    // head is written by the owner thread and tail by the reader.
+    atomic_uint head;
+    atomic_uint tail;
+    // The owner thread has exited, so the reader can free it.
+    atomic_bool dead;
+    struct spewRing *next;
+};
+
+
+static _Atomic(struct spewRing *) rings = NULL;
+static __thread struct spewRing *myRing = NULL;
+static pthread_key_t ringKey;
+static pthread_mutex_t drainMutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_ulong numDropped = 0;
+static bool spewAsync = true;
+
+// The drainer waits on wakeCond when the rings are empty, with
+// drainerWaiting set so spewWrite() knows to signal it.
+static pthread_mutex_t wakeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeCond = PTHREAD_COND_INITIALIZER;
+static atomic_bool drainerWaiting = false;
+
+
+static void ringDestroy(void *ring) {
+
+    // This thread is exiting.  The reader will free the ring after it
+    // writes what is left in it.
+    atomic_store_explicit(&((struct spewRing *) ring)->dead, true,
+            memory_order_release);
+    myRing = NULL;
+}
+
+
+static struct spewRing *getRing(void) {
+
+    if(myRing) return myRing;
+
+    struct spewRing *r = calloc(1, sizeof(*r));
+    if(!r) return NULL;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->dead, false);
+
+    // Push it on the front of the list.  Only the reader takes rings
+    // off the list, and never the first one.
+    r->next = atomic_load(&rings);
+    while(!atomic_compare_exchange_weak(&rings, &r->next, r));
+
+    pthread_setspecific(ringKey, r);
+    myRing = r;
+    return r;
+}
+
+
+// Write out what is in the rings.  Call with drainMutex held.  Returns
+// the number of lines written.
+static size_t drainRings(void) {
+
+    size_t n = 0;
+    struct spewRing *prev = NULL;
+    struct spewRing *r = atomic_load(&rings);
+
+    while(r) {
+
+        bool dead = atomic_load_explicit(&r->dead, memory_order_acquire);
+        unsigned int tail = atomic_load_explicit(&r->tail,
+                memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&r->head,
+                memory_order_acquire);
+
+        for(; tail != head; ++tail, ++n) {
+            struct spewLine *l = &r->lines[tail & (RING_LEN - 1)];
+            fputs(l->text, l->stream);
+        }
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+
+        struct spewRing *next = r->next;
+
+        if(dead && prev) {
+            // The owner thread is gone and we wrote all it spewed.
+            // Threads that push rings only change the list head, which
+            // this is not.
+            prev->next = next;
+            free(r);
+        } else
+            prev = r;
+
+        r = next;
+    }
+
+    unsigned long dropped = atomic_exchange(&numDropped, 0);
+    if(dropped)
+        fprintf(SPEW_FILE, "WARN: %lu spew lines were dropped\n",
+                dropped);
+
+    if(n)
+        fflush(NULL);
+
+    return n;
+}
+
+
+// Returns true if a ring has lines that are not written yet.  This
+// holds drainMutex so qsSpewFlush() can't free a ring under us.
+static bool ringsHaveLines(void) {
+
+    bool have = false;
+    pthread_mutex_lock(&drainMutex);
+    for(struct spewRing *r = atomic_load(&rings); r && !have; r = r->next)
+        have = atomic_load(&r->head) != atomic_load(&r->tail);
+    pthread_mutex_unlock(&drainMutex);
+    return have;
+}
+
+
+static void *drainer(void *arg) {
+
+    while(true) {
+        pthread_mutex_lock(&drainMutex);
+        drainRings();
+        pthread_mutex_unlock(&drainMutex);
+
+        // Wait for more.  We set drainerWaiting before we look at the
+        // rings, and spewWrite() adds its line before it looks at
+        // drainerWaiting, so one of us sees the other.
+        pthread_mutex_lock(&wakeMutex);
+        atomic_store(&drainerWaiting, true);
+        while(!ringsHaveLines())
+            pthread_cond_wait(&wakeCond, &wakeMutex);
+        atomic_store(&drainerWaiting, false);
+        pthread_mutex_unlock(&wakeMutex);
+    }
+    return NULL;
+}
+
+
+void qsSpewFlush(void) {
+
+    if(!spewAsync) return;
+
+    pthread_mutex_lock(&drainMutex);
+    drainRings();
+    pthread_mutex_unlock(&drainMutex);
+}
+
+
+static int parseSpewLevel(const char *str) {
+
+    static const char *names[] = {
+        "off", "error", "warn", "notice", "info", "debug"
+    };
+    for(int i = 0; i < 6; ++i)
+        if(!strcasecmp(str, names[i])) return i;
+    if(!strcasecmp(str, "none")) return 0;
+    char *end;
+    long level = strtol(str, &end, 10);
+    if(end == str || *end) return -1;
+    return level;
+}
+
+
+static void spewInit(void) {
+
+    const char *env = getenv("LIQUIDDSP_SPEW_LEVEL");
+    if(env) {
+        int level = parseSpewLevel(env);
+        if(level >= 0) {
+            if(level > 5) level = 5;
+            atomic_store(&spewLevel, level);
+        } else
+            fprintf(SPEW_FILE, "WARN: bad LIQUIDDSP_SPEW_LEVEL=\"%s\"\n",
+                    env);
+    }
+
+    env = getenv("LIQUIDDSP_SPEW_SYNC");
+    if(env && !strcmp(env, "1"))
+        spewAsync = false;
+
+    if(!spewAsync) return;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    if(pthread_key_create(&ringKey, ringDestroy) ||
+            pthread_attr_init(&attr)) {
+        spewAsync = false;
+        return;
+    }
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&thread, &attr, drainer, NULL))
+        spewAsync = false;
+    pthread_attr_destroy(&attr);
+
+    if(spewAsync)
+        // Don't lose the last lines at exit.
+        atexit(qsSpewFlush);
+}
+
+
+static void spewWrite(FILE *stream, const char *text) {
+
+    if(!stream) return;
+
+    struct spewRing *r;
+
+    if(!spewAsync || !(r = getRing())) {
+        fputs(text, stream);
+        return;
+    }
+
+    unsigned int head = atomic_load_explicit(&r->head,
+            memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&r->tail,
+            memory_order_acquire);
+
+    if(head - tail >= RING_LEN) {
+        atomic_fetch_add_explicit(&numDropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct spewLine *l = &r->lines[head & (RING_LEN - 1)];
+    l->stream = stream;
+    strncpy(l->text, text, BUFLEN - 1);
+    l->text[BUFLEN - 1] = '\0';
+
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&drainerWaiting)) {
+        pthread_mutex_lock(&wakeMutex);
+        pthread_cond_signal(&wakeCond);
+        pthread_mutex_unlock(&wakeMutex);
+    }
+}
+
+
 static void _vspew(FILE *stream, int errn, const char *pre, const char *file,
         int line, const char *func, const char *fmt, va_list ap)
 {
@@ -152,8 +425,7 @@ static void _vspew(FILE *stream, int errn, const char *pre, const char *file,
         buffer[len+1] = '\0';
     }
 
-    if(stream)
-        fputs(buffer, stream);
+    spewWrite(stream, buffer);
 }
 
 
@@ -162,7 +434,9 @@ void qs_spew(int levelIn, FILE *stream, int errn,
         int line, const char *func,
         const char *fmt, ...)
 {
-    if(levelIn > spewLevel)
+    pthread_once(&spewOnce, spewInit);
+
+    if(levelIn > atomic_load_explicit(&spewLevel, memory_order_relaxed))
         // The spew level in is larger (more verbose) than one we let
         // spew.
         return;
@@ -185,6 +459,8 @@ void qs_assertAction(FILE *stream, const char *file,
 {
     pid_t pid;
     pid = getpid();
+    // Write the ASSERT() spew before we exit or sleep.
+    qsSpewFlush();
     if(qsAssertAction)
         // We call the users assert action.  If it does not exit that's
         // okay, we'll just fall into the default behavior.
@@ -36,6 +36,10 @@
    Setting SPEW_LEVEL_NONE with still have ASSERT() spewing and ERROR()
    will not spew.
 
+   At run time the spew level can be turned down with qsSetSpewLevel()
+   or the LIQUIDDSP_SPEW_LEVEL environment variable.  The spew is written
+   to the stream by a background thread; see debug.c.
+
 
 /endverbatim
 
@@ -119,6 +123,13 @@ EXPORT
 void qsSetSpewLevel(int level);
 
 
+// Spew is written by a background thread; see debug.c.  This writes
+// the spew that has not been written yet, and returns after it is
+// written.
+EXPORT
+void qsSpewFlush(void);
+
+
 // This CPP macro function CHECK() is just so we can call most pthread_*()
 // (pthread_mutex_init() for example) and maybe other functions that
 // return 0 on success and an int error number on failure, and asserts on
@@ -0,0 +1,129 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "framecache.h"
+#include "debug.h"
+
+
+
+framecache::framecache(size_t maxFrames_in):
+    maxFrames(maxFrames_in),
+    numHits(0),
+    numMisses(0) {
+
+    ASSERT(maxFrames > 0);
+
+    DSPEW("Caching up to %zu frames", maxFrames);
+}
+
+
+framecache::~framecache() {
+
+    for(lruIt it = lru.begin(); it != lru.end(); ++it)
+        delete *it;
+
+    DSPEW("Frame cache had %" PRIu64 " hits and %" PRIu64 " misses",
+            numHits, numMisses);
+}
+
+
+// 64 bit FNV-1a
+static inline uint64_t fnv1a(uint64_t h, const unsigned char *x,
+        size_t len) {
+
+    for(size_t i = 0; i < len; ++i) {
+        h ^= x[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+
+uint64_t framecache::hash(uint32_t mode, const unsigned char *header,
+        const unsigned char *payload, unsigned int len) {
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = fnv1a(h, (const unsigned char *) &mode, sizeof(mode));
+    h = fnv1a(h, header, HEADER_LEN);
+    return fnv1a(h, payload, len);
+}
+
+
+struct framecache::entry *framecache::lookup(uint64_t h, uint32_t mode,
+        const unsigned char *header,
+        const unsigned char *payload, unsigned int len) {
+
+    std::pair<std::unordered_multimap<uint64_t, struct entry *>::iterator,
+        std::unordered_multimap<uint64_t, struct entry *>::iterator>
+        range = entries.equal_range(h);
+
+    for(; range.first != range.second; ++range.first) {
+        struct entry *e = range.first->second;
+        if(e->mode == mode && e->payload.size() == len &&
+                !memcmp(e->header, header, HEADER_LEN) &&
+                !memcmp(e->payload.data(), payload, len))
+            return e;
+    }
+    return 0;
+}
+
+
+const std::vector<std::complex<float> > *framecache::find(uint32_t mode,
+        const unsigned char *header,
+        const unsigned char *payload, unsigned int len) {
+
+    struct entry *e = lookup(hash(mode, header, payload, len), mode,
+            header, payload, len);
+
+    if(!e) {
+        ++numMisses;
+        return 0;
+    }
+
+    ++numHits;
+    // Move it to the front of the LRU list.
+    lru.splice(lru.begin(), lru, e->lru);
+    return &e->samples;
+}
+
+
+void framecache::insert(uint32_t mode, const unsigned char *header,
+        const unsigned char *payload, unsigned int len,
+        const std::complex<float> *x, size_t n) {
+
+    uint64_t h = hash(mode, header, payload, len);
+
+    struct entry *e = lookup(h, mode, header, payload, len);
+
+    if(e) {
+        lru.splice(lru.begin(), lru, e->lru);
+        e->samples.assign(x, x + n);
+        return;
+    }
+
+    if(lru.size() >= maxFrames) {
+        // Reuse the least recently used entry, and its buffers.
+        e = lru.back();
+        std::pair<std::unordered_multimap<uint64_t,
+            struct entry *>::iterator,
+            std::unordered_multimap<uint64_t, struct entry *>::iterator>
+            range = entries.equal_range(e->hash);
+        for(; range.first != range.second; ++range.first)
+            if(range.first->second == e) {
+                entries.erase(range.first);
+                break;
+            }
+        lru.splice(lru.begin(), lru, e->lru);
+    } else {
+        e = new struct entry;
+        lru.push_front(e);
+        e->lru = lru.begin();
+    }
+
+    e->hash = h;
+    e->mode = mode;
+    memcpy(e->header, header, HEADER_LEN);
+    e->payload.assign(payload, payload + len);
+    e->samples.assign(x, x + n);
+    entries.insert(std::make_pair(h, e));
+}
@@ -0,0 +1,76 @@
+#ifndef __framecache_h__
+#define __framecache_h__
+
+#include <stdint.h>
+
+#include <complex>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+
+// framecache is a least recently used (LRU) cache of the samples of
+// frames that the generator has made, so that sending the same frame
+// again is a memcpy() and not a trip through the frame generator and its
+// IFFTs.  The key is the MCS, the header and the payload.  The
+// numerology and the subcarrier allocation are fixed for a generator,
+// so they are not in the key; each generator has its own cache.
+//
+// Every frame has a new frame count in its header, so the generator only
+// gets hits for HARQ repeats, unless it freezes the header.
+//
+class framecache {
+
+    public:
+
+        framecache(size_t maxFrames);
+        ~framecache();
+
+        // Returns the cached samples of the frame, or 0 if it is not
+        // cached.
+        const std::vector<std::complex<float> > *find(uint32_t mode,
+                const unsigned char *header,
+                const unsigned char *payload, unsigned int len);
+
+        // Add the n samples x of a frame to the cache, dropping the least
+        // recently used frame if the cache is full.
+        void insert(uint32_t mode, const unsigned char *header,
+                const unsigned char *payload, unsigned int len,
+                const std::complex<float> *x, size_t n);
+
+    private:
+
+        struct entry;
+        typedef std::list<struct entry *>::iterator lruIt;
+
+        struct entry {
+            uint64_t hash;
+            uint32_t mode;
+            unsigned char header[HEADER_LEN];
+            std::vector<unsigned char> payload;
+            std::vector<std::complex<float> > samples;
+            // Where we are in the LRU list.
+            lruIt lru;
+        };
+
+        static uint64_t hash(uint32_t mode, const unsigned char *header,
+                const unsigned char *payload, unsigned int len);
+
+        struct entry *lookup(uint64_t h, uint32_t mode,
+                const unsigned char *header,
+                const unsigned char *payload, unsigned int len);
+
+        size_t maxFrames;
+
+        std::unordered_multimap<uint64_t, struct entry *> entries;
+        // Most recently used first.
+        std::list<struct entry *> lru;
+
+        uint64_t numHits;
+        uint64_t numMisses;
+};
+
+
+#endif // #ifndef __framecache_h__
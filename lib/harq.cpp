@@ -0,0 +1,148 @@
+#include <math.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include "harq.h"
+#include "common.h"
+#include "debug.h"
+
+
+
+harq::harq(int maxFrames_in):
+    maxFrames(maxFrames_in),
+    numRecovered(0) {
+
+    ASSERT(maxFrames > 0);
+
+    q = qpacketmodem_create();
+    ASSERT(q, "qpacketmodem_create() failed");
+
+    last.payload_len = 0;
+    last.check = LIQUID_CRC_UNKNOWN;
+    last.fec0 = LIQUID_FEC_UNKNOWN;
+    last.fec1 = LIQUID_FEC_UNKNOWN;
+    last.mod = LIQUID_MODEM_UNKNOWN;
+
+    DSPEW("Keeping up to %d frames for HARQ combining", maxFrames);
+}
+
+
+harq::~harq() {
+
+    qpacketmodem_destroy(q);
+
+    DSPEW("HARQ combining recovered %" PRIu64 " frames", numRecovered);
+}
+
+
+uint64_t harq::key(const unsigned char *header) {
+
+    return getHeaderFrameCount(header) |
+        (((uint64_t) getHeaderStreamId(header)) << 56);
+}
+
+
+bool harq::combine(const unsigned char *header, unsigned int payload_len,
+        crc_scheme check, fec_scheme fec0, fec_scheme fec1,
+        modulation_scheme mod, const std::complex<float> *syms,
+        unsigned int num_syms, float evm, uint8_t *payload) {
+
+    uint64_t k = key(header);
+
+    // We weight each try by the inverse of its noise power, which is
+    // about the EVM squared.
+    float w = powf(10.0f, -evm/10.0f);
+    if(!(w > 0.0f && isfinite(w))) return false;
+
+    std::map<uint64_t, struct entry>::iterator it = entries.find(k);
+
+    if(it != entries.end()) {
+        struct entry *e = &it->second;
+        if(e->payload_len != payload_len || e->check != check ||
+                e->fec0 != fec0 || e->fec1 != fec1 || e->mod != mod ||
+                e->sum.size() != num_syms) {
+            // It's not the same frame.  The frame count may have been
+            // reset.  Start over with this one.
+            forget(header);
+            it = entries.end();
+        }
+    }
+
+    if(it == entries.end()) {
+
+        while(entries.size() >= (size_t) maxFrames) {
+            entries.erase(order.front());
+            order.pop_front();
+        }
+
+        struct entry *e = &entries[k];
+        order.push_back(k);
+        e->payload_len = payload_len;
+        e->check = check;
+        e->fec0 = fec0;
+        e->fec1 = fec1;
+        e->mod = mod;
+        e->sum.resize(num_syms);
+        for(unsigned int i = 0; i < num_syms; ++i)
+            e->sum[i] = w*syms[i];
+        e->weight = w;
+        e->tries = 1;
+        // This one try failed already, so there is nothing to decode.
+        return false;
+    }
+
+    struct entry *e = &it->second;
+
+    combined.resize(num_syms);
+    for(unsigned int i = 0; i < num_syms; ++i) {
+        e->sum[i] += w*syms[i];
+        combined[i] = e->sum[i];
+    }
+    e->weight += w;
+    ++e->tries;
+
+    // Normalize, so the symbols are on the constellation again.
+    float scale = 1.0f/e->weight;
+    for(unsigned int i = 0; i < num_syms; ++i)
+        combined[i] *= scale;
+
+    if(payload_len != last.payload_len || check != last.check ||
+            fec0 != last.fec0 || fec1 != last.fec1 || mod != last.mod) {
+        qpacketmodem_configure(q, payload_len, check, fec0, fec1, mod);
+        last.payload_len = payload_len;
+        last.check = check;
+        last.fec0 = fec0;
+        last.fec1 = fec1;
+        last.mod = mod;
+    }
+    if(qpacketmodem_get_frame_len(q) != num_syms) {
+        ERROR("HARQ frame has %u symbols, not %u", num_syms,
+                qpacketmodem_get_frame_len(q));
+        forget(header);
+        return false;
+    }
+
+    if(!qpacketmodem_decode(q, combined.data(), payload))
+        return false;
+
+    DSPEW("HARQ recovered frame %" PRIu64 " after %d tries",
+            getHeaderFrameCount(header), e->tries);
+    ++numRecovered;
+    forget(header);
+    return true;
+}
+
+
+void harq::forget(const unsigned char *header) {
+
+    uint64_t k = key(header);
+
+    if(!entries.erase(k)) return;
+
+    std::deque<uint64_t>::iterator it =
+        std::find(order.begin(), order.end(), k);
+    DASSERT(it != order.end());
+    order.erase(it);
+}
@@ -0,0 +1,79 @@
+#ifndef __harq_h__
+#define __harq_h__
+
+#include <stdint.h>
+
+#include <complex>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <liquid.h>
+
+
+// harq does Chase combining of the payloads of frames that are sent more
+// than once with the same header, that is the same frame count and
+// stream ID (see ofdmflexframegen::set_harq_repeats()).
+//
+// When a frame has a valid header and a payload that fails its CRC, we
+// keep its equalized payload symbols, keyed by the header.  When the
+// frame comes again and fails again we add the symbols of all the tries,
+// each weighted by 1/(EVM squared), and decode the sum.  So we can get
+// frames that no one try could get.  At most maxFrames frames are kept;
+// the oldest are dropped.
+//
+class harq {
+
+    public:
+
+        harq(int maxFrames);
+        ~harq();
+
+        // Add a failed try of the frame with header and the payload
+        // properties and symbols that go with it.  evm is in dB.
+        // Returns true and sets payload if the combined tries decode.
+        bool combine(const unsigned char *header, unsigned int payload_len,
+                crc_scheme check, fec_scheme fec0, fec_scheme fec1,
+                modulation_scheme mod, const std::complex<float> *syms,
+                unsigned int num_syms, float evm, uint8_t *payload);
+
+        // Drop what we have for the frame with header, because we got
+        // it.
+        void forget(const unsigned char *header);
+
+    private:
+
+        struct entry {
+            unsigned int payload_len;
+            crc_scheme check;
+            fec_scheme fec0;
+            fec_scheme fec1;
+            modulation_scheme mod;
+
+            // Sum of the weighted symbols of all tries, and the sum of
+            // the weights.
+            std::vector<std::complex<float> > sum;
+            float weight;
+            int tries;
+        };
+
+        static uint64_t key(const unsigned char *header);
+
+        int maxFrames;
+
+        std::map<uint64_t, struct entry> entries;
+        // Keys in the order they were added, oldest first.
+        std::deque<uint64_t> order;
+
+        // The payload decoder, which we reconfigure when the payload
+        // properties change.
+        qpacketmodem q;
+        struct entry last;
+
+        std::vector<std::complex<float> > combined;
+
+        uint64_t numRecovered;
+};
+
+
+#endif // #ifndef __harq_h__
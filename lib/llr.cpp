@@ -0,0 +1,91 @@
+#include <math.h>
+#include <float.h>
+
+#include "llr.h"
+#include "debug.h"
+
+
+
+llr::llr(void):
+    mod(LIQUID_MODEM_UNKNOWN),
+    bps(0) {
+}
+
+
+llr::~llr(void) {
+}
+
+
+float llr::demodulate(modulation_scheme mod_in,
+        const std::complex<float> *syms, unsigned int num_syms,
+        std::vector<float> &llrs) {
+
+    if(mod_in != mod) {
+        modem m = modem_create(mod_in);
+        ASSERT(m, "modem_create() failed");
+        bps = modem_get_bps(m);
+        points.resize(1 << bps);
+        for(unsigned int i = 0; i < points.size(); ++i)
+            modem_modulate(m, i, &points[i]);
+        modem_destroy(m);
+        mod = mod_in;
+    }
+
+    llrs.resize(num_syms*bps);
+    minDist.resize(num_syms);
+
+    if(!num_syms) return 0.0f;
+
+    // dist0[k] and dist1[k] are the squared distances to the closest
+    // point with bit k 0 and 1.
+    float dist0[16], dist1[16];
+    ASSERT(bps <= 16);
+
+    double sumDist = 0.0;
+    float *out = llrs.data();
+
+    for(unsigned int n = 0; n < num_syms; ++n) {
+
+        for(unsigned int k = 0; k < bps; ++k)
+            dist0[k] = dist1[k] = FLT_MAX;
+
+        for(unsigned int i = 0; i < points.size(); ++i) {
+            float d = std::norm(syms[n] - points[i]);
+            for(unsigned int k = 0; k < bps; ++k) {
+                // k = 0 is the most significant bit.
+                if((i >> (bps - 1 - k)) & 1) {
+                    if(d < dist1[k]) dist1[k] = d;
+                } else if(d < dist0[k]) dist0[k] = d;
+            }
+        }
+
+        // The closest point is the closest with bit 0 either 0 or 1.
+        minDist[n] = fminf(dist0[0], dist1[0]);
+        sumDist += minDist[n];
+
+        for(unsigned int k = 0; k < bps; ++k)
+            *out++ = dist1[k] - dist0[k];
+    }
+
+    // The noise variance is about the mean squared error of the hard
+    // decisions.
+    float noiseVar = sumDist/num_syms;
+    if(noiseVar < 1.0e-6f) noiseVar = 1.0e-6f;
+
+    float scale = 1.0f/noiseVar;
+    for(size_t i = 0; i < llrs.size(); ++i)
+        llrs[i] *= scale;
+
+    return 10.0f*log10f(noiseVar);
+}
+
+
+void llr::quantize(const float *llrs, size_t n, int8_t *out) {
+
+    for(size_t i = 0; i < n; ++i) {
+        float q = roundf(llrs[i]*LLR_INT8_SCALE);
+        if(q > 127.0f) q = 127.0f;
+        else if(q < -127.0f) q = -127.0f;
+        out[i] = (int8_t) q;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef __llr_h__
+#define __llr_h__
+
+#include <stdint.h>
+
+#include <complex>
+#include <vector>
+
+#include <liquid.h>
+
+
+// The int8 LLRs are the float LLRs times this, rounded and clipped to
+// [-127, 127].
+#define LLR_INT8_SCALE  (8.0f)
+
+
+// llr computes the max-log log likelihood ratios (LLRs) of the bits of
+// received payload symbols, for decoders outside of liquid-dsp.
+//
+// LLR = log(P(bit = 0)/P(bit = 1)), so a positive LLR is a 0 bit.  The
+// bits of each symbol come out most significant bit first, the same
+// order that liquid modulates them, so the LLRs line up with the bits of
+// the encoded payload: the payload and its CRC, encoded with fec0, then
+// interleaved and encoded with fec1 by liquid's packetizer.
+//
+class llr {
+
+    public:
+
+        llr(void);
+        ~llr(void);
+
+        // Set llrs to the num_syms*bps LLRs of the symbols syms that
+        // were modulated with mod.  We estimate the noise variance from
+        // the symbols themselves.  Returns the EVM of the symbols in dB.
+        float demodulate(modulation_scheme mod,
+                const std::complex<float> *syms, unsigned int num_syms,
+                std::vector<float> &llrs);
+
+        // Quantize float LLRs to int8 LLRs.
+        static void quantize(const float *llrs, size_t n, int8_t *out);
+
+    private:
+
+        // The constellation of mod, indexed by symbol value.
+        modulation_scheme mod;
+        unsigned int bps;
+        std::vector<std::complex<float> > points;
+
+        // Per symbol, the squared distance of the closest point.
+        std::vector<float> minDist;
+};
+
+
+#endif // #ifndef __llr_h__
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <liquid.h>
+
+#include "mcs.h"
+
+
+
+static const struct scheme defaultModes[] = {
+
+  {  0, LIQUID_MODEM_BPSK,   LIQUID_FEC_NONE, LIQUID_FEC_GOLAY2412,
+                                    LIQUID_CRC_32, "r1/2 BPSK"       },
+  {  1, LIQUID_MODEM_BPSK,   LIQUID_FEC_NONE, LIQUID_FEC_HAMMING128,
+                                    LIQUID_CRC_32, "r2/3 BPSK"       },
+  {  2, LIQUID_MODEM_QPSK,   LIQUID_FEC_NONE, LIQUID_FEC_GOLAY2412,
+                                    LIQUID_CRC_32, "r1/2 QPSK"       },
+  {  3, LIQUID_MODEM_QPSK,   LIQUID_FEC_NONE, LIQUID_FEC_HAMMING128,
+                                    LIQUID_CRC_32, "r2/3 QPSK"       },
+  {  4, LIQUID_MODEM_QPSK,   LIQUID_FEC_NONE, LIQUID_FEC_SECDED7264,
+                                    LIQUID_CRC_32, "r8/9 QPSK"       },
+  {  5, LIQUID_MODEM_QAM16,  LIQUID_FEC_NONE, LIQUID_FEC_HAMMING128,
+                                    LIQUID_CRC_32, "r2/3 16-QAM"     },
+  {  6, LIQUID_MODEM_QAM16,  LIQUID_FEC_NONE, LIQUID_FEC_SECDED7264,
+                                    LIQUID_CRC_32, "r8/9 16-QAM"     },
+  {  7, LIQUID_MODEM_QAM32,  LIQUID_FEC_NONE, LIQUID_FEC_SECDED7264,
+                                    LIQUID_CRC_32, "r8/9 32-QAM"     },
+  {  8, LIQUID_MODEM_QAM64,  LIQUID_FEC_NONE, LIQUID_FEC_SECDED7264,
+                                    LIQUID_CRC_32, "r8/9 64-QAM"     },
+  {  9, LIQUID_MODEM_QAM128, LIQUID_FEC_NONE, LIQUID_FEC_SECDED7264,
+                                    LIQUID_CRC_32, "r8/9 128-QAM"    },
+  { 10, LIQUID_MODEM_QAM256, LIQUID_FEC_NONE, LIQUID_FEC_SECDED7264,
+                                    LIQUID_CRC_32, "r8/9 256-QAM"    },
+  { 11, LIQUID_MODEM_QAM256, LIQUID_FEC_NONE, LIQUID_FEC_NONE,
+                                    LIQUID_CRC_32, "uncoded 256-QAM" }
+};
+
+
+const std::vector<struct scheme> &getDefaultModes(void) {
+
+    static const std::vector<struct scheme> modes(defaultModes,
+            defaultModes + sizeof(defaultModes)/sizeof(defaultModes[0]));
+    return modes;
+}
+
+
+static void badSpec(const std::string &line, const char *what) {
+
+    throw std::invalid_argument("Bad MCS table entry \"" + line +
+            "\": " + what);
+}
+
+
+// Parse one line of an MCS table spec.  Returns false if the line has no
+// mode in it.
+static bool parseMode(std::string line, struct scheme *mode) {
+
+    size_t comment = line.find('#');
+    if(comment != std::string::npos)
+        line.erase(comment);
+
+    std::istringstream in(line);
+    std::string mod, fec0, fec1, check;
+
+    if(!(in >> mod))
+        // A blank line.
+        return false;
+    if(!(in >> fec0 >> fec1 >> check))
+        badSpec(line, "expected: MOD FEC0 FEC1 CRC [NAME]");
+
+    mode->mod = liquid_getopt_str2mod(mod.c_str());
+    if(mode->mod == LIQUID_MODEM_UNKNOWN)
+        badSpec(line, "unknown modulation scheme");
+    mode->fec0 = liquid_getopt_str2fec(fec0.c_str());
+    if(mode->fec0 == LIQUID_FEC_UNKNOWN)
+        badSpec(line, "unknown fec0 scheme");
+    mode->fec1 = liquid_getopt_str2fec(fec1.c_str());
+    if(mode->fec1 == LIQUID_FEC_UNKNOWN)
+        badSpec(line, "unknown fec1 scheme");
+    mode->check = liquid_getopt_str2crc(check.c_str());
+    if(mode->check == LIQUID_CRC_UNKNOWN)
+        badSpec(line, "unknown CRC scheme");
+
+    std::getline(in >> std::ws, mode->scheme_name);
+    // Remove trailing white space.
+    size_t end = mode->scheme_name.find_last_not_of(" \t\r");
+    mode->scheme_name.erase(end == std::string::npos? 0 : end + 1);
+
+    if(mode->scheme_name.empty()) {
+        // Make up a name like: "qpsk v27+rs8 crc32"
+        mode->scheme_name = std::string(modulation_types[mode->mod].name) +
+            " " + fec_scheme_str[mode->fec0][0] + "+" +
+            fec_scheme_str[mode->fec1][0] + " " +
+            crc_scheme_str[mode->check][0];
+    }
+
+    return true;
+}
+
+
+std::vector<struct scheme> loadModes(const std::string &spec) {
+
+    if(spec.empty())
+        return getDefaultModes();
+
+    std::string text;
+
+    if(spec.find_first_of("\n;") != std::string::npos) {
+        text = spec;
+        for(size_t i = 0; i < text.size(); ++i)
+            if(text[i] == ';') text[i] = '\n';
+    } else {
+        std::ifstream file(spec.c_str());
+        if(!file)
+            throw std::invalid_argument("Can't open MCS table file \"" +
+                    spec + "\"");
+        std::stringstream buf;
+        buf << file.rdbuf();
+        text = buf.str();
+    }
+
+    std::vector<struct scheme> modes;
+    std::istringstream in(text);
+    std::string line;
+
+    while(std::getline(in, line)) {
+        struct scheme mode;
+        if(!parseMode(line, &mode)) continue;
+        mode.mode = modes.size();
+        modes.push_back(mode);
+    }
+
+    if(modes.empty())
+        throw std::invalid_argument("MCS table has no modes in it");
+
+    return modes;
+}
+
+
+const struct scheme *getMode(const std::vector<struct scheme> &modes,
+        int mcs) {
+
+    if(mcs < 0) mcs = 0;
+    else if(mcs > (int) modes.size() - 1) mcs = modes.size() - 1;
+    return &modes[mcs];
+}
+
+
+void setFrameGenProps(ofdmflexframegenprops_s *fgprops,
+        const struct scheme *mode) {
+
+    ofdmflexframegenprops_init_default(fgprops);
+    fgprops->check = mode->check;
+    fgprops->fec1 = mode->fec1;
+    fgprops->fec0 = mode->fec0;
+    // WTF: How come this is a double?
+    fgprops->mod_scheme = (double) mode->mod;
+}
@@ -0,0 +1,62 @@
+#ifndef __mcs_h__
+#define __mcs_h__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <liquid.h>
+
+
+// A modulation and code scheme (MCS) that we can use for the payload of
+// a frame.
+struct scheme {
+
+    uint32_t mode; // We use as the parameter value.
+    // modulation scheme
+    modulation_scheme mod;
+    // FEC (Forward Error Correction) schemes.  fec0 is applied first,
+    // so it's the outer code, and fec1 is the inner code.
+    fec_scheme fec0;
+    fec_scheme fec1;
+    // CRC (Cyclic Redundancy Check) scheme
+    crc_scheme check;
+    std::string scheme_name;
+};
+
+
+// Returns the built in table of modes, which is what we get with an
+// empty MCS table spec.
+extern const std::vector<struct scheme> &getDefaultModes(void);
+
+
+// Returns the table of modes from spec.  spec is either empty, for the
+// default modes, or the path of a file, or the table itself if it has a
+// newline or a ';' in it.  The table has one mode per line, or per ';'
+// separated part, and the modes are numbered in order starting at 0:
+//
+//     MOD FEC0 FEC1 CRC [NAME]
+//
+// where MOD, FEC0, FEC1 and CRC are liquid-dsp names, like the names
+// that liquid's examples take on their command lines: for example
+//
+//     qpsk rs8 v27 crc32 QPSK RS + r1/2 conv
+//
+// Text after a '#' is a comment.  Convolutional and Reed-Solomon codes
+// need liquid-dsp to be built with libfec.  This throws
+// std::invalid_argument if spec is no good.
+extern std::vector<struct scheme> loadModes(const std::string &spec);
+
+
+// Returns the mode for mcs, where mcs is clipped to the range of modes.
+extern const struct scheme *getMode(const std::vector<struct scheme> &modes,
+        int mcs);
+
+
+// Set the liquid frame generator properties for the mode.
+extern void setFrameGenProps(ofdmflexframegenprops_s *fgprops,
+        const struct scheme *mode);
+
+
+#endif // #ifndef __mcs_h__
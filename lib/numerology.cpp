@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <complex>
+#include <stdexcept>
+
+#include "numerology.h"
+#include "mcs.h"
+#include "qpacketframe.h"
+#include "debug.h"
+
+
+
+numerology::numerology(unsigned int M_in, unsigned int cp_len_in,
+        unsigned int taper_len_in, const unsigned char *p_in):
+    M(M_in),
+    cp_len(cp_len_in),
+    taper_len(taper_len_in),
+    alloc(p_in, p_in + M_in) {
+
+    ofdmframe_validate_sctype(alloc.data(), M, &numNull, &numPilot,
+            &numData);
+}
+
+
+bool numerology::lengthKey::operator<(const struct lengthKey &k) const {
+
+    if(payload_len != k.payload_len) return payload_len < k.payload_len;
+    if(framing != k.framing) return framing < k.framing;
+    if(mod != k.mod) return mod < k.mod;
+    if(fec0 != k.fec0) return fec0 < k.fec0;
+    if(fec1 != k.fec1) return fec1 < k.fec1;
+    return check < k.check;
+}
+
+
+size_t numerology::frameLength(int framing, const struct scheme *mode,
+        size_t payload_len) const {
+
+    struct lengthKey key;
+    key.payload_len = payload_len;
+    key.framing = framing;
+    key.mod = mode->mod;
+    key.fec0 = mode->fec0;
+    key.fec1 = mode->fec1;
+    key.check = mode->check;
+
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+
+        std::map<struct lengthKey, size_t>::iterator it = lengths.find(key);
+        if(it != lengths.end())
+            return it->second;
+    }
+
+    // We have not seen this one before, so we make a frame and count
+    // the samples.  We don't hold d_mutex while we do, so the other
+    // blocks with this numerology don't wait for us.  Two threads may
+    // both count a new one, and get the same length.
+    ofdmflexframegenprops_s fgprops;
+    setFrameGenProps(&fgprops, mode);
+
+    std::vector<uint8_t> payload(payload_len, 0);
+    unsigned char header[HEADER_LEN];
+    packHeader(header, 0, 0);
+    size_t len = 0;
+
+    if(framing == FRAMING_QPACKET) {
+        qpacketframegen qg(M, cp_len, taper_len, p(), &fgprops);
+        qg.assemble(header, payload.data(), payload_len);
+        // The generators write COMPLEX_PER_WRITE samples at a time.
+        len = (qg.frame_len() + COMPLEX_PER_WRITE - 1)/
+            COMPLEX_PER_WRITE*COMPLEX_PER_WRITE;
+    } else {
+        ::ofdmflexframegen fg = ofdmflexframegen_create(M, cp_len,
+                taper_len, p(), &fgprops);
+        ASSERT(fg, "ofdmflexframegen_create() failed");
+        ofdmflexframegen_assemble(fg, header, payload.data(), payload_len);
+
+        std::complex<float> buf[COMPLEX_PER_WRITE];
+        bool last_symbol = false;
+        while(!last_symbol) {
+            last_symbol = ofdmflexframegen_write(fg, buf,
+                    COMPLEX_PER_WRITE);
+            len += COMPLEX_PER_WRITE;
+        }
+        ofdmflexframegen_destroy(fg);
+    }
+
+    gr::thread::scoped_lock guard(d_mutex);
+    lengths[key] = len;
+
+    return len;
+}
+
+
+const numerology *getNumerology(unsigned int M, unsigned int cp_len,
+        unsigned int taper_len, const unsigned char *p) {
+
+    static gr::thread::mutex mutex;
+    static std::map<std::string, numerology *> cache;
+
+    std::vector<unsigned char> defaultAlloc;
+    if(!p) {
+        defaultAlloc.resize(M);
+        ofdmframe_init_default_sctype(M, defaultAlloc.data());
+        p = defaultAlloc.data();
+    }
+
+    // The key is all the parameters as bytes.
+    std::string key;
+    key.append((const char *) &M, sizeof(M));
+    key.append((const char *) &cp_len, sizeof(cp_len));
+    key.append((const char *) &taper_len, sizeof(taper_len));
+    key.append((const char *) p, M);
+
+    gr::thread::scoped_lock guard(mutex);
+
+    std::map<std::string, numerology *>::iterator it = cache.find(key);
+    if(it != cache.end())
+        return it->second;
+
+    numerology *n = new numerology(M, cp_len, taper_len, p);
+    cache[key] = n;
+
+    DSPEW("New numerology: %u subcarriers (%u null, %u pilot, %u data),"
+            " cyclic prefix %u, taper %u", M, n->numNull, n->numPilot,
+            n->numData, cp_len, taper_len);
+
+    return n;
+}
+
+
+const numerology *getNumerology(const std::string &subcarriers) {
+
+    if(subcarriers.empty())
+        return getNumerology();
+
+    std::vector<unsigned char> p;
+    unsigned int numPilot = 0, numData = 0, numS0 = 0;
+
+    for(size_t i = 0; i < subcarriers.size(); ++i) {
+        char c = subcarriers[i];
+        unsigned char type;
+        if(isspace(c))
+            continue;
+        else if(c == '.' || c == '0')
+            type = OFDMFRAME_SCTYPE_NULL;
+        else if(c == 'P' || c == 'p' || c == '1') {
+            type = OFDMFRAME_SCTYPE_PILOT;
+            ++numPilot;
+        } else if(c == '+' || c == '2') {
+            type = OFDMFRAME_SCTYPE_DATA;
+            ++numData;
+        } else
+            throw std::invalid_argument(std::string("Bad character '") +
+                    c + "' in subcarrier allocation \"" + subcarriers +
+                    "\"");
+        if(type != OFDMFRAME_SCTYPE_NULL && p.size() % 2 == 0)
+            ++numS0;
+        p.push_back(type);
+    }
+
+    char msg[128];
+
+    if(p.size() != NUM_SUBCARRIERS) {
+        snprintf(msg, sizeof(msg), "Subcarrier allocation has %zu"
+                " subcarriers, not %d", p.size(), NUM_SUBCARRIERS);
+        throw std::invalid_argument(msg);
+    }
+    // These would make liquid print an error and exit, or fail to create
+    // its objects.
+    if(numPilot < 2)
+        throw std::invalid_argument("Subcarrier allocation needs at"
+                " least 2 pilot subcarriers");
+    if(numData < 1)
+        throw std::invalid_argument("Subcarrier allocation needs at"
+                " least 1 data subcarrier");
+    if(numS0 < 1)
+        throw std::invalid_argument("Subcarrier allocation needs an even"
+                " subcarrier that is not null");
+
+    return getNumerology(NUM_SUBCARRIERS, CP_LEN, TAPER_LEN, p.data());
+}
@@ -0,0 +1,116 @@
+#ifndef __numerology_h__
+#define __numerology_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gnuradio/thread/thread.h>
+
+#include <liquid.h>
+
+#include "common.h"
+
+struct scheme;
+
+
+// A numerology is the OFDM parameters that the generator and the
+// synchronizer have to agree on: the number of subcarriers, the cyclic
+// prefix and taper lengths, and the subcarrier allocation.
+//
+// getNumerology() keeps one numerology object for each numerology in a
+// process wide cache, so all the blocks with the same numerology share
+// one subcarrier allocation map and one table of frame lengths.  They
+// are never freed; a process only has a few.
+//
+// liquid's ofdmframegen, ofdmflexframegen and their synchronizers make
+// their own FFT plans and preamble sequences and copy the allocation
+// map, and liquid has no way to give them shared ones, so each of those
+// still has its own.
+//
+class numerology {
+
+    public:
+
+        const unsigned int M;
+        const unsigned int cp_len;
+        const unsigned int taper_len;
+
+        // The number of subcarriers of each type.
+        unsigned int numNull;
+        unsigned int numPilot;
+        unsigned int numData;
+
+        // The subcarrier allocation, OFDMFRAME_SCTYPE_* for each of the M
+        // subcarriers.  It's not const because liquid's create functions
+        // want an unsigned char *, but they only copy it.  Don't change
+        // it.
+        unsigned char *p(void) const {
+            return (unsigned char *) alloc.data();
+        }
+
+        // Returns the number of samples in a frame with a payload_len
+        // byte payload sent with mode, where framing is FRAMING_FLEXFRAME
+        // or FRAMING_QPACKET.  The first call for a length makes a frame
+        // to count its samples, without blocking the other callers.
+        size_t frameLength(int framing, const struct scheme *mode,
+                size_t payload_len) const;
+
+        // Returns the number of samples in a liquid ofdmflexframe with a
+        // payload_len byte payload sent with mode.
+        size_t flexframeLength(const struct scheme *mode,
+                size_t payload_len) const {
+            return frameLength(FRAMING_FLEXFRAME, mode, payload_len);
+        }
+
+    private:
+
+        friend const numerology *getNumerology(unsigned int M,
+                unsigned int cp_len, unsigned int taper_len,
+                const unsigned char *p);
+
+        numerology(unsigned int M, unsigned int cp_len,
+                unsigned int taper_len, const unsigned char *p);
+
+        std::vector<unsigned char> alloc;
+
+        // frameLength() values keyed by framing and payload properties.
+        struct lengthKey {
+            size_t payload_len;
+            int framing, mod, fec0, fec1, check;
+            bool operator<(const struct lengthKey &k) const;
+        };
+        mutable gr::thread::mutex d_mutex;
+        mutable std::map<struct lengthKey, size_t> lengths;
+};
+
+
+// Returns the shared numerology with M subcarriers, a cp_len cyclic
+// prefix, a taper_len taper, and subcarrier allocation p, where p = 0 is
+// liquid's default allocation.  This is thread safe.
+extern const numerology *getNumerology(unsigned int M = NUM_SUBCARRIERS,
+        unsigned int cp_len = CP_LEN, unsigned int taper_len = TAPER_LEN,
+        const unsigned char *p = 0);
+
+
+// Returns the shared numerology for the subcarrier allocation in the
+// string subcarriers, with NUM_SUBCARRIERS, CP_LEN and TAPER_LEN.  An
+// empty string is liquid's default allocation.  Otherwise it has one
+// character for each subcarrier, in liquid's order, which starts at DC:
+//
+//     '.' or '0'  null (guard band or DC)
+//     'P' or '1'  pilot
+//     '+' or '2'  data
+//
+// White space is ignored.  There must be at least 2 pilots and 1 data
+// subcarrier, and at least one even subcarrier that is not null for the
+// S0 preamble symbols.  The generator and the synchronizer must use the
+// same allocation.  This throws std::invalid_argument if
+// subcarriers is no good.
+extern const numerology *getNumerology(const std::string &subcarriers);
+
+
+#endif // #ifndef __numerology_h__
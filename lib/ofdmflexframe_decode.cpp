@@ -0,0 +1,211 @@
+// This is a command line program that decodes the ofdmflexframe frames in
+// a raw IQ recording file, using all the CPUs.  It memory maps the file
+// so we do not copy the samples before we decode them.
+//
+// Run: ofdmflexframe_decode -h
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdexcept>
+
+#include <liquid.h>
+
+#include "ofdmflexframebatch.h"
+#include "debug.h"
+
+
+using gr::liquidDSP::ofdmflexframebatch;
+using gr::liquidDSP::batch_frame_stats;
+
+
+static void usage(const char *argv0) {
+
+    fprintf(stderr,
+"  Usage: %s [OPTIONS] IQ_FILE\n"
+"\n"
+"  Decode the liquid ofdmflexframe frames in the raw IQ recording\n"
+"  IQ_FILE, like from a GNU radio file sink.  The file is cut into\n"
+"  overlapping chunks that are decoded in parallel.\n"
+"\n"
+"                OPTIONS\n"
+"\n"
+"  -a ALLOC      the subcarrier allocation that the frames were sent\n"
+"                with, a character for each subcarrier: '.' null, 'P'\n"
+"                pilot or '+' data.  The default is liquid's.\n"
+"\n"
+"  -f FORMAT     the sample format of IQ_FILE: cf32 (complex float 32)\n"
+"                or sc16 (complex int16).  The default is cf32.\n"
+"\n"
+"  -h            print this help and exit\n"
+"\n"
+"  -j THREADS    decode with THREADS threads.  The default is one per\n"
+"                CPU.\n"
+"\n"
+"  -o OVERLAP    overlap chunks by OVERLAP samples.  Frames longer than\n"
+"                this may be lost.  The default is 65536.\n"
+"\n"
+"  -p FILE       write the payloads of the frames to FILE, one after the\n"
+"                other.  The default is payloads.bin.\n"
+"\n"
+"  -s FILE       write one line of stats for each frame to FILE.  The\n"
+"                default is stats.csv.\n"
+"\n", argv0);
+}
+
+
+int main(int argc, char **argv) {
+
+    const char *payloadsPath = "payloads.bin";
+    const char *statsPath = "stats.csv";
+    int format = ofdmflexframebatch::CF32;
+    size_t sampleSize = 2*sizeof(float);
+    int nthreads = 0;
+    size_t overlap = 1 << 16;
+    const char *subcarriers = "";
+    int c;
+
+    while((c = getopt(argc, argv, "a:f:hj:o:p:s:")) != -1) {
+        switch(c) {
+            case 'a':
+                subcarriers = optarg;
+                break;
+            case 'f':
+                if(!strcmp(optarg, "cf32")) {
+                    format = ofdmflexframebatch::CF32;
+                    sampleSize = 2*sizeof(float);
+                } else if(!strcmp(optarg, "sc16")) {
+                    format = ofdmflexframebatch::SC16;
+                    sampleSize = 2*sizeof(int16_t);
+                } else {
+                    fprintf(stderr, "Unknown sample format \"%s\"\n",
+                            optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case 'j':
+                nthreads = strtol(optarg, 0, 10);
+                break;
+            case 'o':
+                overlap = strtoul(optarg, 0, 10);
+                break;
+            case 'p':
+                payloadsPath = optarg;
+                break;
+            case 's':
+                statsPath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Make the decoder, which checks the subcarrier allocation, before
+    // we read the file.
+    ofdmflexframebatch *batch;
+    try {
+        batch = new ofdmflexframebatch(nthreads, overlap, "", subcarriers);
+    } catch(std::invalid_argument &e) {
+        ERROR("%s", e.what());
+        return 1;
+    }
+
+    const char *path = argv[optind];
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        ERROR("open(\"%s\") failed", path);
+        return 1;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st)) {
+        ERROR("fstat(\"%s\") failed", path);
+        return 1;
+    }
+
+    size_t numSamples = st.st_size/sampleSize;
+    if(numSamples == 0) {
+        ERROR("\"%s\" has no samples", path);
+        return 1;
+    }
+
+    void *samples = mmap(0, numSamples*sampleSize, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+    if(samples == MAP_FAILED) {
+        ERROR("mmap(\"%s\") failed", path);
+        return 1;
+    }
+    close(fd);
+
+    // Every thread reads its own part of the file from beginning to end.
+    madvise(samples, numSamples*sampleSize, MADV_SEQUENTIAL);
+
+    size_t numFrames = batch->decode(samples, numSamples, format);
+
+    munmap(samples, numSamples*sampleSize);
+
+    const std::vector<uint8_t> &payloads = batch->payloads();
+    const std::vector<batch_frame_stats> &stats = batch->stats();
+
+    FILE *file = fopen(payloadsPath, "w");
+    if(!file) {
+        ERROR("fopen(\"%s\") failed", payloadsPath);
+        return 1;
+    }
+    if(payloads.size() &&
+            fwrite(payloads.data(), payloads.size(), 1, file) != 1) {
+        ERROR("writing \"%s\" failed", payloadsPath);
+        return 1;
+    }
+    fclose(file);
+
+    file = fopen(statsPath, "w");
+    if(!file) {
+        ERROR("fopen(\"%s\") failed", statsPath);
+        return 1;
+    }
+    fprintf(file, "sample,payload_offset,payload_len,frame_count,"
+            "stream_id,header_valid,payload_valid,evm,rssi,cfo,"
+            "mod_scheme\n");
+    size_t numValid = 0;
+    for(size_t i = 0; i < stats.size(); ++i) {
+        const batch_frame_stats &s = stats[i];
+        fprintf(file, "%" PRIu64 ",%" PRIu64 ",%" PRIu32 ",%" PRIu64
+                ",%" PRIu32 ",%" PRId32 ",%" PRId32 ",%g,%g,%g,%s\n",
+                s.sample, s.payload_offset, s.payload_len,
+                s.frame_count, s.stream_id,
+                s.header_valid, s.payload_valid,
+                s.evm, s.rssi, s.cfo,
+                (s.mod_scheme > 0 &&
+                 s.mod_scheme < LIQUID_MODEM_NUM_SCHEMES)?
+                    modulation_types[s.mod_scheme].name : "unknown");
+        if(s.payload_valid) ++numValid;
+    }
+    fclose(file);
+
+    fprintf(stderr, "Found %zu frames, %zu with valid payloads,"
+            " in %zu samples\n", numFrames, numValid, numSamples);
+
+    delete batch;
+
+    return 0;
+}
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <stdexcept>
+
+#include <gnuradio/thread/thread_group.h>
+
+// Liquid-DSP docs:
+//
+// https://liquidsdr.org/doc/ofdmflexframe/
+//
+#include <liquid.h>
+
+#include "ofdmflexframebatch.h"
+#include "debug.h"
+#include "common.h"
+#include "mcs.h"
+#include "numerology.h"
+
+
+// Decoders feed their synchronizer this many samples at a time.  Frames
+// are reported at the end of the step that they end in, so chunk
+// boundaries are multiples of this.
+#define DECODE_STEP  (256)
+
+
+namespace gr {
+namespace liquidDSP {
+
+
+// What a decode worker thread works on.
+struct decoder {
+
+    const void *samples;
+    size_t numSamples;
+    int format;
+
+    // The chunks are from the list of chunk boundaries: chunk i is
+    // samples [chunks[i], chunks[i+1]).
+    const std::vector<size_t> *chunks;
+    size_t overlap;
+
+    gr::thread::mutex *mutex;
+    size_t *nextChunk;
+
+    // The results of each chunk.
+    std::vector<std::vector<struct batch_frame_stats> > *stats;
+    std::vector<std::vector<uint8_t> > *payloads;
+
+    // The chunk we are working on, and where we are in it.
+    size_t chunk;
+    size_t chunkBegin;
+    uint64_t position;
+};
+
+
+extern "C" {
+
+static
+int
+batchSyncCallback(unsigned char *header, int header_valid,
+                unsigned char *payload, unsigned int payload_len,
+                int payload_valid, ::framesyncstats_s stats,
+                struct decoder *d) {
+
+    if(d->position <= d->chunkBegin && d->chunkBegin != 0)
+        // This frame ended in the overlap before the chunk, so it
+        // belongs to the previous chunk.
+        return 0;
+
+    std::vector<uint8_t> &payloads = (*d->payloads)[d->chunk];
+
+    struct batch_frame_stats s;
+    memset(&s, 0, sizeof(s));
+    s.sample = d->position;
+    s.payload_offset = payloads.size();
+    s.header_valid = header_valid;
+    s.payload_valid = payload_valid;
+    s.evm = stats.evm;
+    s.rssi = stats.rssi;
+    s.cfo = stats.cfo;
+    s.mod_scheme = stats.mod_scheme;
+
+    if(header_valid) {
+        s.frame_count = getHeaderFrameCount(header);
+        s.stream_id = getHeaderStreamId(header);
+        s.payload_len = payload_len;
+        payloads.insert(payloads.end(), payload, payload + payload_len);
+    }
+
+    (*d->stats)[d->chunk].push_back(s);
+
+    return 0;
+}
+} // extern "C" {
+
+
+static void convertSC16(const int16_t *in, std::complex<float> *out,
+        size_t n) {
+
+    for(size_t i = 0; i < n; ++i)
+        out[i] = std::complex<float>(in[2*i], in[2*i+1]) *
+            (1.0f/32768.0f);
+}
+
+
+static void decodeWorker(struct decoder *d, const numerology *num) {
+
+    ::ofdmflexframesync fs = ofdmflexframesync_create(num->M,
+            num->cp_len, num->taper_len, num->p(),
+            (framesync_callback) batchSyncCallback, d);
+    ASSERT(fs, "ofdmflexframesync_create() failed");
+
+    std::complex<float> buf[DECODE_STEP];
+    const std::vector<size_t> &chunks = *d->chunks;
+
+    while(true) {
+
+        {
+            gr::thread::scoped_lock guard(*d->mutex);
+            d->chunk = (*d->nextChunk)++;
+        }
+        if(d->chunk >= chunks.size() - 1)
+            break;
+
+        d->chunkBegin = chunks[d->chunk];
+        size_t end = chunks[d->chunk + 1];
+        size_t i = 0;
+        if(d->chunkBegin > d->overlap)
+            // Start at a step boundary so we report frames at the same
+            // positions as the decoder of the previous chunk.
+            i = ((d->chunkBegin - d->overlap)/DECODE_STEP)*DECODE_STEP;
+
+        ofdmflexframesync_reset(fs);
+
+        for(; i < end; i += DECODE_STEP) {
+
+            size_t n = DECODE_STEP;
+            if(i + n > end) n = end - i;
+            d->position = i + n;
+
+            std::complex<float> *x;
+            if(d->format == ofdmflexframebatch::SC16) {
+                convertSC16(((const int16_t *) d->samples) + 2*i, buf, n);
+                x = buf;
+            } else
+                x = ((std::complex<float> *) d->samples) + i;
+
+            ofdmflexframesync_execute(fs, x, n);
+        }
+    }
+
+    ofdmflexframesync_destroy(fs);
+}
+
+
+static void encodeWorker(const uint8_t *payloads,
+        const uint32_t *payload_lens, const size_t *offsets,
+        size_t begin, size_t end, const struct scheme *mode,
+        std::complex<float> *out, const numerology *num) {
+
+    ofdmflexframegenprops_s fgprops;
+    setFrameGenProps(&fgprops, mode);
+
+    ::ofdmflexframegen fg = ofdmflexframegen_create(num->M,
+            num->cp_len, num->taper_len, num->p(), &fgprops);
+    ASSERT(fg, "ofdmflexframegen_create() failed");
+
+    size_t payloadOffset = 0;
+    for(size_t i = 0; i < begin; ++i)
+        payloadOffset += payload_lens[i];
+
+    for(size_t i = begin; i < end; ++i) {
+
+        unsigned char header[HEADER_LEN];
+        packHeader(header, i, 0);
+        ofdmflexframegen_assemble(fg, header,
+                payloads + payloadOffset, payload_lens[i]);
+        payloadOffset += payload_lens[i];
+
+        std::complex<float> *obuf = out + offsets[i];
+        bool last_symbol = false;
+        while(!last_symbol) {
+            last_symbol = ofdmflexframegen_write(fg, obuf,
+                    COMPLEX_PER_WRITE);
+            obuf += COMPLEX_PER_WRITE;
+        }
+        DASSERT(obuf == out + offsets[i+1]);
+    }
+
+    ofdmflexframegen_destroy(fg);
+}
+
+
+ofdmflexframebatch::ofdmflexframebatch(int nthreads, size_t overlap,
+        const std::string &mcs_table, const std::string &subcarriers):
+        d_nthreads(nthreads),
+        d_overlap(overlap),
+        d_numerology(getNumerology(subcarriers)),
+        d_modes(new std::vector<struct scheme>(loadModes(mcs_table))) {
+
+    if(d_nthreads <= 0)
+        d_nthreads = gr::thread::thread::hardware_concurrency();
+    if(d_nthreads <= 0)
+        d_nthreads = 1;
+
+    // The overlap needs to be a whole number of decoder steps.
+    d_overlap = ((d_overlap + DECODE_STEP - 1)/DECODE_STEP)*DECODE_STEP;
+}
+
+
+int ofdmflexframebatch::num_data_subcarriers(void) const {
+
+    return d_numerology->numData;
+}
+
+
+ofdmflexframebatch::~ofdmflexframebatch() {
+
+    delete d_modes;
+}
+
+
+size_t ofdmflexframebatch::frame_length(size_t payload_len, int mcs) {
+
+    // The lengths are cached in the shared numerology.
+    return d_numerology->flexframeLength(getMode(*d_modes, mcs),
+            payload_len);
+}
+
+
+size_t ofdmflexframebatch::encode_length(const uint32_t *payload_lens,
+        size_t num_payloads, int mcs) {
+
+    size_t len = 0;
+    for(size_t i = 0; i < num_payloads; ++i)
+        len += frame_length(payload_lens[i], mcs);
+    return len;
+}
+
+
+size_t ofdmflexframebatch::encode(const uint8_t *payloads,
+        const uint32_t *payload_lens, size_t num_payloads, int mcs,
+        std::complex<float> *out, size_t out_len) {
+
+    // Where each frame starts in out.  We know this before we make any
+    // frames, so the threads can write their frames in place.
+    std::vector<size_t> offsets(num_payloads + 1, 0);
+    for(size_t i = 0; i < num_payloads; ++i)
+        offsets[i+1] = offsets[i] + frame_length(payload_lens[i], mcs);
+
+    if(offsets[num_payloads] > out_len)
+        throw std::invalid_argument("ofdmflexframebatch::encode() output"
+                " buffer is too small");
+
+    size_t nthreads = d_nthreads;
+    if(nthreads > num_payloads)
+        nthreads = num_payloads;
+
+    const struct scheme *mode = getMode(*d_modes, mcs);
+    gr::thread::thread_group threads;
+
+    for(size_t t = 0; t < nthreads; ++t) {
+        size_t begin = (num_payloads*t)/nthreads;
+        size_t end = (num_payloads*(t+1))/nthreads;
+        threads.create_thread([=, &offsets]() {
+            encodeWorker(payloads, payload_lens, offsets.data(),
+                    begin, end, mode, out, d_numerology);
+        });
+    }
+    threads.join_all();
+
+    return offsets[num_payloads];
+}
+
+
+size_t ofdmflexframebatch::decode(const void *samples,
+        size_t num_samples, int format) {
+
+    if(format != CF32 && format != SC16)
+        throw std::invalid_argument("ofdmflexframebatch::decode()"
+                " unknown sample format");
+
+    d_payloads.clear();
+    d_stats.clear();
+
+    // Cut the input into chunks of at least 8 overlaps, so we do not
+    // spend much time decoding the overlaps twice.  Chunks are whole
+    // decoder steps, except the last one.
+    size_t chunkLen = num_samples/d_nthreads + 1;
+    if(chunkLen < 8*d_overlap)
+        chunkLen = 8*d_overlap;
+    chunkLen = ((chunkLen + DECODE_STEP - 1)/DECODE_STEP)*DECODE_STEP;
+
+    std::vector<size_t> chunks;
+    for(size_t i = 0; i < num_samples; i += chunkLen)
+        chunks.push_back(i);
+    chunks.push_back(num_samples);
+
+    size_t numChunks = chunks.size() - 1;
+    size_t nthreads = d_nthreads;
+    if(nthreads > numChunks)
+        nthreads = numChunks;
+
+    std::vector<std::vector<struct batch_frame_stats> > stats(numChunks);
+    std::vector<std::vector<uint8_t> > payloads(numChunks);
+    gr::thread::mutex mutex;
+    size_t nextChunk = 0;
+
+    std::vector<struct decoder> decoders(nthreads);
+    gr::thread::thread_group threads;
+
+    for(size_t t = 0; t < nthreads; ++t) {
+        struct decoder *d = &decoders[t];
+        d->samples = samples;
+        d->numSamples = num_samples;
+        d->format = format;
+        d->chunks = &chunks;
+        d->overlap = d_overlap;
+        d->mutex = &mutex;
+        d->nextChunk = &nextChunk;
+        d->stats = &stats;
+        d->payloads = &payloads;
+        threads.create_thread([=]() {
+            decodeWorker(d, d_numerology);
+        });
+    }
+    threads.join_all();
+
+    // Put the results of the chunks together, in order.
+    for(size_t i = 0; i < numChunks; ++i) {
+        size_t offset = d_payloads.size();
+        for(size_t j = 0; j < stats[i].size(); ++j)
+            stats[i][j].payload_offset += offset;
+        d_stats.insert(d_stats.end(), stats[i].begin(), stats[i].end());
+        d_payloads.insert(d_payloads.end(),
+                payloads[i].begin(), payloads[i].end());
+    }
+
+    DSPEW("Decoded %zu frames from %zu samples in %zu chunks",
+            d_stats.size(), num_samples, numChunks);
+
+    return d_stats.size();
+}
+
+
+size_t ofdmflexframebatch::encode_length_buffer(size_t payload_lens,
+        size_t num_payloads, int mcs) {
+
+    return encode_length((const uint32_t *) payload_lens,
+            num_payloads, mcs);
+}
+
+
+size_t ofdmflexframebatch::encode_buffer(size_t payloads,
+        size_t payload_lens, size_t num_payloads, int mcs,
+        size_t out, size_t out_len) {
+
+    return encode((const uint8_t *) payloads,
+            (const uint32_t *) payload_lens, num_payloads, mcs,
+            (std::complex<float> *) out, out_len);
+}
+
+
+size_t ofdmflexframebatch::decode_buffer(size_t samples,
+        size_t num_samples, int format) {
+
+    return decode((const void *) samples, num_samples, format);
+}
+
+
+void ofdmflexframebatch::copy_payloads(size_t out) const {
+
+    if(d_payloads.size())
+        memcpy((void *) out, d_payloads.data(), d_payloads.size());
+}
+
+
+void ofdmflexframebatch::copy_stats(size_t out) const {
+
+    if(d_stats.size())
+        memcpy((void *) out, d_stats.data(),
+                d_stats.size()*sizeof(struct batch_frame_stats));
+}
+
+
+} /* namespace liquidDSP */
+} /* namespace gr */
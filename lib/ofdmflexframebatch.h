@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include <complex>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gnuradio/attributes.h>
+#include <gnuradio/thread/thread.h>
+
+
+#ifndef API
+#  define API __GR_ATTR_EXPORT
+#endif
+
+
+struct scheme;
+class numerology;
+
+
+namespace gr {
+  namespace liquidDSP {
+
+    /*!
+     * \brief The stats of one frame found by ofdmflexframebatch::decode().
+     *
+     * This has a fixed layout so that python can see an array of them as
+     * a numpy structured array; see python/batch.py.
+     */
+    struct batch_frame_stats {
+
+      uint64_t sample;          // input sample index at the end of the frame
+      uint64_t payload_offset;  // byte offset into the decoded payloads
+      uint64_t frame_count;     // frame counter from the frame header
+      uint32_t payload_len;     // payload length in bytes
+      uint32_t stream_id;       // stream ID from the frame header
+      int32_t header_valid;
+      int32_t payload_valid;
+      float evm;                // error vector magnitude [dB]
+      float rssi;               // received signal strength [dB]
+      float cfo;                // carrier frequency offset [f/Fs]
+      int32_t mod_scheme;       // liquid modulation_scheme of the payload
+    };
+
+    /*!
+     * \brief Offline encoding and decoding of whole sample buffers with
+     * the same frames as ofdmflexframegen and ofdmflexframesync, without
+     * a flowgraph.
+     *
+     * The work is split across nthreads threads, each with its own liquid
+     * frame generator or synchronizer.  Decoding cuts the input into
+     * chunks that overlap by overlap samples, so frames that are longer
+     * than overlap samples may be lost at chunk boundaries.
+     *
+     * The python interface passes buffer addresses, like from
+     * numpy_array.ctypes.data, so no samples are copied between python
+     * and this code.  See python/batch.py.
+     *
+     * \ingroup liquidDSP
+     */
+    class API ofdmflexframebatch
+    {
+     public:
+
+      // Sample formats for decode()
+      enum { CF32 = 0, /* complex float 32 */ SC16 = 1 /* complex int16 */ };
+
+      /*!
+       * \param nthreads number of worker threads, 0 for one per CPU
+       * \param overlap  number of samples that decode chunks overlap
+       * \param mcs_table the modulation code schemes that encode() picks
+       *                 from, like in ofdmflexframegen::make()
+       * \param subcarriers the subcarrier allocation, like in
+       *                 ofdmflexframegen::make()
+       */
+      ofdmflexframebatch(int nthreads = 0, size_t overlap = 1 << 16,
+              const std::string &mcs_table = "",
+              const std::string &subcarriers = "");
+      ~ofdmflexframebatch();
+
+      // We own the worker state, so we can't be copied.
+      ofdmflexframebatch(const ofdmflexframebatch &) = delete;
+      ofdmflexframebatch &operator=(const ofdmflexframebatch &) = delete;
+
+      // Returns the number of data subcarriers in the allocation
+      int num_data_subcarriers(void) const;
+
+      // Returns the number of complex samples in a frame with a payload
+      // of payload_len bytes using modulation code scheme mcs.
+      size_t frame_length(size_t payload_len, int mcs);
+
+      // Returns the number of complex samples that encode() writes for
+      // the payloads with lengths payload_lens.
+      size_t encode_length(const uint32_t *payload_lens,
+              size_t num_payloads, int mcs);
+
+      // Encode num_payloads payloads that are packed one after the
+      // other in payloads, with lengths payload_lens, into out.  The
+      // frame counter in the header of each frame is its index.  Returns
+      // the number of samples written to out.
+      size_t encode(const uint8_t *payloads, const uint32_t *payload_lens,
+              size_t num_payloads, int mcs,
+              std::complex<float> *out, size_t out_len);
+
+      // Decode num_samples samples in the sample format format.  Returns
+      // the number of frames found.  Get the results with payloads() and
+      // stats() or with copy_payloads() and copy_stats().
+      size_t decode(const void *samples, size_t num_samples,
+              int format = CF32);
+
+      const std::vector<uint8_t> &payloads(void) const {
+          return d_payloads;
+      }
+      const std::vector<struct batch_frame_stats> &stats(void) const {
+          return d_stats;
+      }
+
+      // Versions of the above for python, with buffer addresses.
+
+      size_t encode_length_buffer(size_t payload_lens, size_t num_payloads,
+              int mcs);
+
+      size_t encode_buffer(size_t payloads, size_t payload_lens,
+              size_t num_payloads, int mcs, size_t out, size_t out_len);
+
+      size_t decode_buffer(size_t samples, size_t num_samples,
+              int format = CF32);
+
+      size_t payloads_size(void) const { return d_payloads.size(); }
+      size_t stats_size(void) const { return d_stats.size(); }
+      static size_t stats_item_size(void) {
+          return sizeof(struct batch_frame_stats);
+      }
+
+      void copy_payloads(size_t out) const;
+      void copy_stats(size_t out) const;
+
+     private:
+
+      int d_nthreads;
+      size_t d_overlap;
+
+      // The shared subcarrier allocation and frame length table, from
+      // lib/numerology.h
+      const ::numerology *d_numerology;
+
+      // The MCS table, from lib/mcs.h
+      std::vector<struct ::scheme> *d_modes;
+
+      std::vector<uint8_t> d_payloads;
+      std::vector<struct batch_frame_stats> d_stats;
+    };
+
+  } // namespace liquidDSP
+} // namespace gr
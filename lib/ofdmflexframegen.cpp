@@ -2,14 +2,18 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
 
-#include <iostream>
+#include <vector>
 
 #include <gnuradio/io_signature.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
 
 // Liquid-DSP docs:
 //
@@ -20,37 +24,14 @@
 #include "ofdmflexframegen.h"
 #include "debug.h"
 #include "common.h"
+#include "mcs.h"
+#include "qpacketframe.h"
+#include "framecache.h"
+#include "numerology.h"
+#include "autotune.h"
 
 
 
-struct scheme {
-
-    uint32_t mode; // We use as the parameter value.
-    // modulation scheme
-    modulation_scheme mod;
-    // FEC (Forward Error Correction) scheme
-    fec_scheme fec;
-    const char *scheme_name;
-};
-
-
-static const struct scheme modes[] = {
-
-  {  0, LIQUID_MODEM_BPSK,   LIQUID_FEC_GOLAY2412,  "r1/2 BPSK"       },
-  {  1, LIQUID_MODEM_BPSK,   LIQUID_FEC_HAMMING128, "r2/3 BPSK"       },
-  {  2, LIQUID_MODEM_QPSK,   LIQUID_FEC_GOLAY2412,  "r1/2 QPSK"       },
-  {  3, LIQUID_MODEM_QPSK,   LIQUID_FEC_HAMMING128, "r2/3 QPSK"       },
-  {  4, LIQUID_MODEM_QPSK,   LIQUID_FEC_SECDED7264, "r8/9 QPSK"       },
-  {  5, LIQUID_MODEM_QAM16,  LIQUID_FEC_HAMMING128, "r2/3 16-QAM"     },
-  {  6, LIQUID_MODEM_QAM16,  LIQUID_FEC_SECDED7264, "r8/9 16-QAM"     },
-  {  7, LIQUID_MODEM_QAM32,  LIQUID_FEC_SECDED7264, "r8/9 32-QAM"     },
-  {  8, LIQUID_MODEM_QAM64,  LIQUID_FEC_SECDED7264, "r8/9 64-QAM"     },
-  {  9, LIQUID_MODEM_QAM128, LIQUID_FEC_SECDED7264, "r8/9 128-QAM"    },
-  { 10, LIQUID_MODEM_QAM256, LIQUID_FEC_SECDED7264, "r8/9 256-QAM"    },
-  { 11, LIQUID_MODEM_QAM256, LIQUID_FEC_NONE,       "uncoded 256-QAM" }
-};
-
-
 namespace gr {
 namespace liquidDSP {
 
@@ -60,15 +41,75 @@ class frame_impl : public ofdmflexframegen {
     private:
         int d_in_item_sz;
         int d_out_item_sz;
+        int d_num_streams;
+        int d_framing;
+
+        // The input port that general_work() looks at first.  We go
+        // around the ports round-robin so no stream can starve another.
+        int nextStream = 0;
 
         gr::thread::mutex d_mutex;
 
+        // We have fg for FRAMING_FLEXFRAME or qg for FRAMING_QPACKET.
+        // They are the generator of the MCS of the frame we are making,
+        // from fgs or qgs, which have a generator for each MCS in modes
+        // that we have used.  So changing the MCS from frame to frame
+        // is just picking a generator.
         ::ofdmflexframegen fg = 0;
-        unsigned char *subcarrierAlloc = 0;
-
-        // Liquid-DSP lets us add a uint64_t to every frame we send
-        // so we add a counter by using this variable.
-        uint64_t frameCount = 0;
+        qpacketframegen *qg = 0;
+        std::vector<::ofdmflexframegen> fgs;
+        std::vector<qpacketframegen *> qgs;
+
+        // The shared subcarrier allocation and such.
+        const numerology *d_numerology;
+
+        // The MCS from set_mcs().
+        uint32_t d_mode = 0;
+
+        // The MCS from the last "mcs" tag on each input port, or -1 if
+        // there has been none and we use d_mode.
+        std::vector<int> portMode;
+        // Items left in the packet from the last "packet_len" tag on each
+        // input port.
+        std::vector<uint64_t> packetLeft;
+        pmt::pmt_t mcsTag;
+        pmt::pmt_t packetLenTag;
+        std::vector<gr::tag_t> tags;
+        std::vector<gr::tag_t> forecastTags;
+
+        // Liquid-DSP lets us add 8 bytes to every frame we send so we
+        // add a counter for each stream, and the stream ID; see
+        // packHeader() in common.h.
+        std::vector<uint64_t> frameCount;
+
+        // For HARQ we send each frame d_harqRepeats more times.  We keep
+        // the header and payload of the last frame until repeatsLeft is
+        // 0.
+        int d_harqRepeats = 0;
+        int repeatsLeft = 0;
+        unsigned char lastHeader[HEADER_LEN];
+        std::vector<unsigned char> lastPayload;
+        uint32_t lastMode;
+
+        // If set we keep the samples of the frames we make, and send a
+        // frame from the cache if we have it.  With d_freezeHeader every
+        // frame has frame count FROZEN_FRAME_COUNT, so the header only
+        // depends on the stream.
+        framecache *d_cache = 0;
+        bool d_freezeHeader = false;
+
+        // With d_autoTune we measure a full size frame of the MCS at
+        // set_mcs() and size the output buffer and multiple to it.  The
+        // scheduler only reads those at start(), so after d_started we
+        // just keep the numbers.
+        bool d_autoTune = false;
+        bool d_started = false;
+        size_t d_tunedFrameLen = 0;
+        double d_tunedFrameTime = 0.0;
+        long d_tunedBufferItems = 0;
+
+        // The modulation code schemes that set_mcs() picks from.
+        std::vector<struct scheme> modes;
 
         // Sizes of stream input to output in this ratio:
         static const int maxBytesIn = 128;
@@ -77,14 +118,62 @@ class frame_impl : public ofdmflexframegen {
 
         static constexpr double relative_rate = maxBytesOut/maxBytesIn;
 
+        // The most samples in a frame, that of the longest MCS in modes
+        // with a full size payload.  Low rate codes and allocations with
+        // few data subcarriers make longer frames.
+        size_t d_maxFrameLen;
+
         int setMode(uint32_t i);
 
+        // Returns the length of a full size frame of the longest MCS in
+        // modes.
+        size_t maxFrameLen(void) const;
+
+        // Set fg or qg to the generator for mode i.  Call with d_mutex
+        // held.
+        void selectGen(uint32_t i);
+
+        // Returns the number of input items of port for the next frame,
+        // which is 0 if we have to wait for more of a packet, and sets
+        // *mode to the MCS of the frame.
+        int frameItems(int port, int ninput, uint32_t *mode);
+
+        // For forecast(): the input items that port needs for a frame if
+        // no tag or end of stream cuts the frame short, and whether an
+        // "mcs" or "packet_len" tag comes after the first of the avail
+        // items of port.
+        int itemsWanted(int port, int noutput_items);
+        bool tagAhead(int port, int avail);
+
+        // Measure the frame of mode d_mode and set the output buffer and
+        // multiple.  Call without d_mutex held, since timing frames
+        // takes a while.
+        void autoTune(void);
+
+        // Returns true if a frame of mode with a lenIn byte payload fits
+        // in noutput_items.  Without d_autoTune the output multiple is
+        // d_maxFrameLen, so every frame fits; with it the output multiple
+        // is for d_mode and a tag can pick a longer MCS.
+        bool frameFits(uint32_t mode, int lenIn, int noutput_items);
+
     public:
     
-        frame_impl(size_t in_item_sz);
+        frame_impl(size_t in_item_sz, int num_streams, int framing,
+                const std::string &mcs_table,
+                const std::string &subcarriers);
         ~frame_impl();
 
         void set_mcs(int mcs);
+        int num_mcs(void) { return modes.size(); }
+        int num_data_subcarriers(void) { return d_numerology->numData; }
+        void set_harq_repeats(int repeats);
+        void set_frame_cache(int max_frames, bool freeze_header);
+        void set_auto_tune(bool on);
+        int tuned_frame_len(void) { return d_tunedFrameLen; }
+        double tuned_frame_time(void) { return d_tunedFrameTime; }
+        long tuned_buffer_items(void) { return d_tunedBufferItems; }
+
+        bool start(void);
 
         void forecast (int noutput_items, gr_vector_int &ninput_items_required);
 
@@ -96,53 +185,198 @@ class frame_impl : public ofdmflexframegen {
 
 
 boost::shared_ptr<ofdmflexframegen>
-ofdmflexframegen::make(size_t in_item_sz) {
+ofdmflexframegen::make(size_t in_item_sz, int num_streams, int framing,
+        const std::string &mcs_table, const std::string &subcarriers) {
 
-    return gnuradio::get_initial_sptr(new frame_impl(in_item_sz));
+    return gnuradio::get_initial_sptr(
+            new frame_impl(in_item_sz, num_streams, framing, mcs_table,
+                subcarriers));
 }
 
 
 void frame_impl::set_mcs(int mcs) {
 
-    if(mcs < 0) mcs = 0;
-    else if(mcs > 11) mcs = 11;
-    setMode(mcs);
+    setMode(getMode(modes, mcs)->mode);
 }
 
 
-int frame_impl::setMode(uint32_t i)
-{
-    //std::cerr << "liquid DSP VERSION: " << liquid_version << std::endl;
-    const struct scheme *mode = modes + i;
+void frame_impl::set_harq_repeats(int repeats) {
 
-    ofdmflexframegenprops_s fgprops; // frame generator properties
-    ofdmflexframegenprops_init_default(&fgprops);
-    fgprops.check = LIQUID_CRC_32;
-    fgprops.fec1 = mode->fec;
-    fgprops.fec0 = LIQUID_FEC_NONE;
-    // WTF: How come this is a double?
-    fgprops.mod_scheme = (double) mode->mod;
+    if(repeats < 0)
+        throw std::invalid_argument("ofdmflexframegen HARQ repeats"
+                " must not be less than 0");
 
-    if(!subcarrierAlloc) {
-        subcarrierAlloc = (unsigned char *) malloc(NUM_SUBCARRIERS);
-        ASSERT(subcarrierAlloc, "malloc() failed");
-        ofdmframe_init_default_sctype(NUM_SUBCARRIERS, subcarrierAlloc);
+    gr::thread::scoped_lock guard(d_mutex);
+    d_harqRepeats = repeats;
+    if(repeatsLeft > repeats)
+        repeatsLeft = repeats;
+}
+
+
+void frame_impl::selectGen(uint32_t i) {
+
+    if(d_framing == FRAMING_QPACKET) {
+        if(!qgs[i]) {
+            ofdmflexframegenprops_s fgprops; // frame generator properties
+            setFrameGenProps(&fgprops, &modes[i]);
+            qgs[i] = new qpacketframegen(d_numerology->M,
+                    d_numerology->cp_len, d_numerology->taper_len,
+                    d_numerology->p(), &fgprops);
+        }
+        qg = qgs[i];
+    } else {
+        if(!fgs[i]) {
+            ofdmflexframegenprops_s fgprops; // frame generator properties
+            setFrameGenProps(&fgprops, &modes[i]);
+            fgs[i] = ofdmflexframegen_create(d_numerology->M,
+                    d_numerology->cp_len, d_numerology->taper_len,
+                    d_numerology->p(), &fgprops);
+            ASSERT(fgs[i], "ofdmflexframegen_create() failed");
+        }
+        fg = fgs[i];
+    }
+}
+
+
+void frame_impl::set_frame_cache(int max_frames, bool freeze_header) {
+
+    if(max_frames < 0)
+        throw std::invalid_argument("ofdmflexframegen frame cache"
+                " max_frames must not be less than 0");
+
+    framecache *c = 0;
+    if(max_frames)
+        c = new framecache(max_frames);
+
+    framecache *old;
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        old = d_cache;
+        d_cache = c;
+        d_freezeHeader = freeze_header;
+    }
+
+    if(old)
+        delete old;
+}
+
+
+bool frame_impl::start(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+    d_started = true;
+    return true;
+}
+
+
+void frame_impl::set_auto_tune(bool on) {
+
+    if(on) {
+        autoTune();
+        return;
     }
 
-    // Protect fg from general_work()
     gr::thread::scoped_lock guard(d_mutex);
 
-    if(fg) {
-        ofdmflexframegen_setprops(fg, &fgprops);
-        frameCount = 0;
-    } else
-        fg = ofdmflexframegen_create(NUM_SUBCARRIERS, CP_LEN,
-                TAPER_LEN, subcarrierAlloc, &fgprops);
+    d_autoTune = false;
+    if(!d_started)
+        set_output_multiple(d_maxFrameLen);
+}
+
+
+void frame_impl::autoTune(void) {
+
+    size_t payload_len = (maxBytesIn/d_in_item_sz)*d_in_item_sz;
+    uint32_t mode;
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        mode = d_mode;
+    }
+
+    // general_work() can go on while we time frames with a generator of
+    // our own.
+    size_t frameLen = d_numerology->frameLength(d_framing, &modes[mode],
+            payload_len);
+    double frameTime = timeFrameGen(d_numerology, d_framing,
+            &modes[mode], payload_len);
+
+    // An "mcs" tag can pick any MCS, so the buffer must hold frames of
+    // the longest.
+    size_t maxLen = d_maxFrameLen;
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    d_autoTune = true;
+    d_tunedFrameLen = frameLen;
+    d_tunedFrameTime = frameTime;
+    d_tunedBufferItems = autotuneBufferFrames(frameTime)*maxLen;
+
+    if(d_started) {
+        // Too late for the scheduler to see a new buffer size or output
+        // multiple.  frameFits() still keeps frames in the output.
+        DSPEW("Auto tuned \"%s\" while running: frame %zu samples,"
+                " %.1f usec; output buffer unchanged",
+                modes[mode].scheme_name.c_str(), d_tunedFrameLen,
+                1.0e6*d_tunedFrameTime);
+        return;
+    }
+
+    set_output_multiple(d_tunedFrameLen);
+    set_min_output_buffer(d_tunedBufferItems);
+
+    DSPEW("Auto tuned \"%s\": frame %zu samples, %.1f usec;"
+            " output buffer %ld items", modes[mode].scheme_name.c_str(),
+            d_tunedFrameLen, 1.0e6*d_tunedFrameTime, d_tunedBufferItems);
+}
+
+
+bool frame_impl::frameFits(uint32_t mode, int lenIn, int noutput_items) {
+
+    if(noutput_items >= (int) d_maxFrameLen)
+        return true;
+
+    return d_numerology->frameLength(d_framing, &modes[mode], lenIn) <=
+        (size_t) noutput_items;
+}
+
+
+size_t frame_impl::maxFrameLen(void) const {
+
+    size_t payload_len = (maxBytesIn/d_in_item_sz)*d_in_item_sz;
+    size_t maxLen = 0;
+
+    for(size_t i = 0; i < modes.size(); ++i) {
+        size_t len = d_numerology->frameLength(d_framing, &modes[i],
+                payload_len);
+        if(len > maxLen) maxLen = len;
+    }
+    return maxLen;
+}
+
+
+int frame_impl::setMode(uint32_t i)
+{
+    const struct scheme *mode = &modes[i];
+    bool tune;
+
+    {
+        // Protect fg and qg from general_work()
+        gr::thread::scoped_lock guard(d_mutex);
+
+        // Repeats of the last frame would not be the same frame.
+        repeatsLeft = 0;
+
+        selectGen(i);
+        d_mode = i;
+        frameCount.assign(d_num_streams, 0);
+        tune = d_autoTune;
+    }
 
-    ASSERT(fg);
+    if(tune)
+        autoTune();
 
     DSPEW("Set liquid frame scheme to (%" PRIu32
-                    "): \"%s\"", mode->mode, mode->scheme_name);
+                    "): \"%s\"", mode->mode, mode->scheme_name.c_str());
 
     return 0; // success
 }
@@ -150,19 +384,49 @@ int frame_impl::setMode(uint32_t i)
 /*
  * The private constructor
  */
-frame_impl::frame_impl(size_t in_item_sz)
+frame_impl::frame_impl(size_t in_item_sz, int num_streams, int framing,
+        const std::string &mcs_table, const std::string &subcarriers)
         : gr::block("ofdmflexframegen",
-              gr::io_signature::make(1, 1, in_item_sz),
+              gr::io_signature::make(num_streams, num_streams, in_item_sz),
               gr::io_signature::make(1, 1, sizeof(std::complex<float>))),
         d_in_item_sz (in_item_sz),
-        d_out_item_sz (sizeof(std::complex<float>)) {
-
-    std::cerr << "liquid DSP VERSION: " << liquid_version << std::endl;
+        d_out_item_sz (sizeof(std::complex<float>)),
+        d_num_streams (num_streams),
+        d_framing (framing),
+        d_numerology (getNumerology(subcarriers)),
+        frameCount (num_streams, 0),
+        modes (loadModes(mcs_table)) {
+
+    fgs.assign(modes.size(), 0);
+    qgs.assign(modes.size(), 0);
+    portMode.assign(num_streams, -1);
+    packetLeft.assign(num_streams, 0);
+    mcsTag = pmt::intern("mcs");
+    packetLenTag = pmt::intern("packet_len");
+
+    // We use up the "mcs" and "packet_len" tags, and the offsets of
+    // input tags mean nothing in the output.
+    set_tag_propagation_policy(TPP_DONT);
+
+    INFO("liquid DSP VERSION: %s", liquid_version);
 
     ASSERT((d_out_item_sz % d_in_item_sz) == 0);
     ASSERT(d_out_item_sz >= d_in_item_sz);
 
-    if(setMode(5))
+    if(num_streams < 1 || num_streams > MAX_STREAMS)
+        throw std::invalid_argument("ofdmflexframegen num_streams"
+                " must be in the range [1, 256]");
+    if(framing != FRAMING_FLEXFRAME && framing != FRAMING_QPACKET)
+        throw std::invalid_argument("ofdmflexframegen unknown framing");
+
+    // So the scheduler gives us room for a whole frame of any MCS in the
+    // table, with this subcarrier allocation.
+    d_maxFrameLen = maxFrameLen();
+    set_min_output_buffer(d_maxFrameLen);
+    set_output_multiple(d_maxFrameLen);
+
+    // Start with mode 5, r2/3 16-QAM in the default table.
+    if(setMode(getMode(modes, 5)->mode))
         throw std::runtime_error("ofdmflexframegen failed");
 
     set_relative_rate(relative_rate);
@@ -171,25 +435,163 @@ frame_impl::frame_impl(size_t in_item_sz)
 
 frame_impl::~frame_impl() {
 
-    if(fg) {
-        ofdmflexframegen_destroy(fg);
-        fg = 0;
-        frameCount = 0;
+    for(size_t i = 0; i < fgs.size(); ++i)
+        if(fgs[i])
+            ofdmflexframegen_destroy(fgs[i]);
+    for(size_t i = 0; i < qgs.size(); ++i)
+        if(qgs[i])
+            delete qgs[i];
+    fg = 0;
+    qg = 0;
+
+    if(d_cache) {
+        delete d_cache;
+        d_cache = 0;
     }
 
-    if(subcarrierAlloc) {
-        free(subcarrierAlloc);
-        subcarrierAlloc = 0;
-    }
-
-    std::cerr << "process terminating" << std::endl;
+    INFO("ofdmflexframegen destructor called");
 }
 
 
 void frame_impl::forecast(int noutput_items,
         gr_vector_int &ninput_items_required) {
 
-    ninput_items_required[0] = ((double) noutput_items)/relative_rate;
+    // With more than one stream any one input with data is enough to
+    // make a frame, so we can't require input on all ports.  Repeats
+    // need no input.
+    for(int i = 0; i < d_num_streams; ++i)
+        ninput_items_required[i] = 0;
+    if(repeatsLeft)
+        return;
+
+    // If we asked for less than a frame needs the scheduler would call
+    // general_work() over and over while it can't make one.  So we ask
+    // for the input of a frame on the first port, in round-robin order,
+    // that has it, or else on the first that can still get it.  A tag or
+    // the end of the stream makes a frame shorter.  The scheduler calls
+    // us again when any input changes.  If all the inputs are done we
+    // ask on nextStream, and the scheduler finishes.
+    int port = nextStream;
+    int pick = -1;
+    int pickItems = 1;
+    for(int i = 0; i < d_num_streams; ++i) {
+        gr::buffer_reader_sptr in = detail()->input(port);
+        int avail = in->items_available();
+        int want = itemsWanted(port, noutput_items);
+        if(avail >= want) {
+            pick = port;
+            pickItems = want;
+            break;
+        }
+        if(avail > 0 && (in->done() || tagAhead(port, avail))) {
+            pick = port;
+            pickItems = avail;
+            break;
+        }
+        if(pick < 0 && !in->done()) {
+            pick = port;
+            pickItems = want;
+        }
+        port = (port + 1) % d_num_streams;
+    }
+    if(pick < 0) {
+        pick = nextStream;
+        pickItems = 1;
+    }
+    ninput_items_required[pick] = pickItems;
+}
+
+
+int frame_impl::itemsWanted(int port, int noutput_items) {
+
+    int maxItems = maxBytesIn/d_in_item_sz;
+
+    if(packetLeft[port])
+        return packetLeft[port] < (uint64_t) maxItems ?
+            packetLeft[port] : maxItems;
+
+    if(d_num_streams > 1)
+        return 1;
+
+    // With one stream we wait for about a frame's worth of input.
+    int n = ((double) noutput_items)/relative_rate;
+    if(n < 1) n = 1;
+    if(n > maxItems) n = maxItems;
+    return n;
+}
+
+
+bool frame_impl::tagAhead(int port, int avail) {
+
+    uint64_t start = nitems_read(port);
+
+    get_tags_in_range(forecastTags, port, start + 1, start + avail);
+
+    for(size_t i = 0; i < forecastTags.size(); ++i)
+        if(pmt::eq(forecastTags[i].key, mcsTag) ||
+                pmt::eq(forecastTags[i].key, packetLenTag))
+            return true;
+    return false;
+}
+
+
+int frame_impl::frameItems(int port, int ninput, uint32_t *mode) {
+
+    int maxItems = maxBytesIn/d_in_item_sz;
+    uint64_t start = nitems_read(port);
+    int n = ninput;
+    // The input ends at a tag, or the stream ends, so we can't wait for
+    // more of a packet.
+    bool cut = detail()->input(port)->done();
+
+    get_tags_in_range(tags, port, start, start + ninput);
+
+    for(size_t i = 0; i < tags.size(); ++i) {
+        const gr::tag_t *t = &tags[i];
+        if(!pmt::eq(t->key, mcsTag) && !pmt::eq(t->key, packetLenTag))
+            continue;
+        if(t->offset > start) {
+            // A frame does not go past a tag, so the next frame starts
+            // at it.
+            if((int) (t->offset - start) < n)
+                n = t->offset - start;
+            cut = true;
+            continue;
+        }
+        if(!pmt::is_integer(t->value)) {
+            WARN("Ignoring \"%s\" tag that is not an integer",
+                    pmt::symbol_to_string(t->key).c_str());
+            continue;
+        }
+        long val = pmt::to_long(t->value);
+        if(pmt::eq(t->key, mcsTag))
+            portMode[port] = getMode(modes, val)->mode;
+        else
+            packetLeft[port] = val > 0 ? val : 0;
+    }
+
+    if(packetLeft[port] && cut && packetLeft[port] > (uint64_t) n) {
+        // The packet is shorter than its tag said.  It ends at the next
+        // tag, or at the end of the stream, so we send what there is.
+        DSPEW("Input port %d packet ends %" PRIu64 " items early", port,
+                packetLeft[port] - n);
+        packetLeft[port] = n;
+    }
+
+    if(packetLeft[port]) {
+        // We try to put the whole packet in one frame, so we wait for
+        // all of it, up to the most that fits in a frame.
+        uint64_t want = packetLeft[port];
+        if(want > (uint64_t) maxItems) want = maxItems;
+        if((uint64_t) n < want) return 0;
+        n = want;
+    }
+
+    if(n > maxItems) n = maxItems;
+
+    *mode = portMode[port] >= 0 ? portMode[port] : d_mode;
+
+    return n;
 }
 
 
@@ -203,35 +605,112 @@ int frame_impl::general_work(int noutput_items,
 
     std::complex<float> *obuf = (std::complex<float> *) output_items[0];
 
-    int lenIn = ninput_items[0]*d_in_item_sz;
+    unsigned char header[HEADER_LEN];
+    const unsigned char *payload;
+    int port;
+    int lenIn;
+    uint32_t mode;
+
+    if(repeatsLeft) {
+        // Send the last frame again.
+        if(!frameFits(lastMode, lastPayload.size(), noutput_items))
+            return 0;
+        --repeatsLeft;
+        memcpy(header, lastHeader, HEADER_LEN);
+        payload = lastPayload.data();
+        lenIn = lastPayload.size();
+        port = -1; // We consume no input.
+        mode = lastMode;
+    } else {
+
+        // Find the next stream, in round-robin order, that has input
+        // for a frame.
+        mode = d_mode;
+        int n = 0;
+        port = nextStream;
+        int i;
+        for(i = 0; i < d_num_streams; ++i) {
+            if(ninput_items[port] > 0 &&
+                    (n = frameItems(port, ninput_items[port], &mode)))
+                break;
+            port = (port + 1) % d_num_streams;
+        }
+        if(i == d_num_streams)
+            // No port has input for a frame.
+            return 0;
+        if(!frameFits(mode, n*d_in_item_sz, noutput_items))
+            // We wait for room in the output buffer.
+            return 0;
+        nextStream = (port + 1) % d_num_streams;
+
+        lenIn = n*d_in_item_sz;
+        if(packetLeft[port])
+            packetLeft[port] -= n;
+
+        if(d_cache && d_freezeHeader)
+            // The synchronizer does not take these as repeats of each
+            // other.
+            packHeader(header, FROZEN_FRAME_COUNT, port);
+        else
+            packHeader(header, frameCount[port]++, port);
+        payload = (const unsigned char *) input_items[port];
+
+        if(d_harqRepeats) {
+            memcpy(lastHeader, header, HEADER_LEN);
+            lastPayload.assign(payload, payload + lenIn);
+            lastMode = mode;
+            repeatsLeft = d_harqRepeats;
+        }
+    }
 
-    if(lenIn > maxBytesIn)
-        lenIn = maxBytesIn;
+    int numComplexOut = 0;
 
-    ofdmflexframegen_assemble(
-            fg, (unsigned char *) &frameCount,
-            (const unsigned char *) input_items[0], lenIn);
-    ++frameCount;
- 
-    bool last_symbol = false;
+    if(d_cache) {
+        const std::vector<std::complex<float> > *x =
+            d_cache->find(mode, header, payload, lenIn);
+        if(x) {
+            // We made this frame before.
+            memcpy(obuf, x->data(), x->size()*sizeof(std::complex<float>));
+            numComplexOut = x->size();
+            if(port >= 0)
+                consume(port, lenIn / d_in_item_sz);
+            return numComplexOut;
+        }
+    }
 
-#define COMPLEX_PER_WRITE  (8)
+    selectGen(mode);
 
-    int numComplexOut = 0;
+    if(qg)
+        qg->assemble(header, payload, lenIn);
+    else
+        ofdmflexframegen_assemble(fg, header, payload, lenIn);
+ 
+    bool last_symbol = false;
 
     // The interface to ofdmflexframegen_write()
     // https://liquidsdr.org/doc/ofdmflexframe/
     //
     while(!last_symbol) {
 
-        ASSERT(numComplexOut + COMPLEX_PER_WRITE <=
-                maxBytesOut/sizeof(std::complex<float>));
-        last_symbol = ofdmflexframegen_write(fg, obuf, COMPLEX_PER_WRITE);
+        ASSERT(numComplexOut + COMPLEX_PER_WRITE <= noutput_items);
+        if(qg)
+            last_symbol = qg->write(obuf, COMPLEX_PER_WRITE);
+        else
+            last_symbol = ofdmflexframegen_write(fg, obuf,
+                    COMPLEX_PER_WRITE);
         obuf += COMPLEX_PER_WRITE;
         numComplexOut += COMPLEX_PER_WRITE;
     }
 
-    consume_each(lenIn / d_in_item_sz);
+    if(d_cache && (d_freezeHeader || repeatsLeft)) {
+        // Without a frozen header the frame can only be used again by
+        // HARQ repeats.
+        d_cache->insert(mode, header, payload, lenIn,
+                (std::complex<float> *) output_items[0], numComplexOut);
+    }
+
+    if(port >= 0)
+        consume(port, lenIn / d_in_item_sz);
 
     return numComplexOut;
 }
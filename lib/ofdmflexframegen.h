@@ -1,3 +1,5 @@
+#include <string>
+
 #include <gnuradio/block.h>
 #include <gnuradio/attributes.h>
 
@@ -24,12 +26,87 @@ namespace gr {
        * \brief Return a shared_ptr to a new instance of
        * liquidDSP::ofdmflexframegen.
        *
+       * \param in_item_sz  size of the input stream items in bytes
+       * \param num_streams number of input ports.  Each input port is a
+       *                    logical stream and its port number is sent
+       *                    as the stream ID in the frame header.
+       * \param framing     0 for liquid ofdmflexframe frames, or 1 for
+       *                    qpacketframe frames, which ofdmflexframesync
+       *                    can decode with its pipelined receiver.
+       * \param mcs_table   the modulation code schemes that set_mcs()
+       *                    picks from: empty for the built in table, or a
+       *                    file name, or the table itself.  See lib/mcs.h
+       *                    for the format.  The output buffer holds a
+       *                    128 byte frame of the longest MCS.
+       * \param subcarriers the subcarrier allocation: empty for liquid's
+       *                    default, or a character for each of the 64
+       *                    subcarriers, '.' null, 'P' pilot or '+' data.
+       *                    See lib/numerology.h.  The synchronizer must
+       *                    use the same allocation.
+       *
+       * Input stream tags can set the MCS per packet.  An integer "mcs"
+       * tag sets the MCS of the frames of its input port from the tagged
+       * item on, instead of set_mcs().  An integer "packet_len" tag
+       * starts a packet of that many items, which we wait for and put in
+       * one frame, or as few frames as it fits in.  A frame never goes
+       * past one of these tags, so each frame starts at the item it
+       * names.
        */
       static boost::shared_ptr<ofdmflexframegen>
-          make(size_t in_item_sz);
+          make(size_t in_item_sz, int num_streams = 1, int framing = 0,
+                  const std::string &mcs_table = "",
+                  const std::string &subcarriers = "");
 
-      // Set the modulation code scheme
+      // Set the modulation code scheme, the index into the MCS table
       virtual void set_mcs(int mcs) = 0;
+
+      // Returns the number of modulation code schemes in the MCS table
+      virtual int num_mcs(void) = 0;
+
+      // Returns the number of data subcarriers in the allocation
+      virtual int num_data_subcarriers(void) = 0;
+
+      // Send each frame repeats more times, with the same frame count,
+      // so ofdmflexframesync::set_harq() can combine the tries.
+      virtual void set_harq_repeats(int repeats) = 0;
+
+      /*!
+       * \brief Keep the samples of up to max_frames frames in a least
+       * recently used cache, and send a frame from the cache when we
+       * have its MCS, header and payload.  0 turns it off.
+       *
+       * With freeze_header every frame has the same frame count,
+       * FROZEN_FRAME_COUNT in lib/common.h, so frames with the same
+       * payload, like beacons, come from the cache.  The synchronizer
+       * does not drop or combine those frames as HARQ repeats, so each
+       * HARQ repeat of one arrives as a copy.  Without it only HARQ
+       * repeats come from the cache.
+       */
+      virtual void set_frame_cache(int max_frames,
+              bool freeze_header = false) = 0;
+
+      /*!
+       * \brief Size the output buffer and the output multiple from the
+       * measured frame length and frame CPU time of the MCS.
+       *
+       * When it is on, the block measures a full size frame of the MCS
+       * now and at every set_mcs().  The output multiple is that frame
+       * length, and the minimum output buffer holds a whole number of
+       * frames of the longest MCS, enough frames to cover a couple of
+       * milliseconds of work.  The buffer size and output multiple only
+       * take effect if this is called before the flowgraph starts; later
+       * the block only measures.  See lib/autotune.h.
+       */
+      virtual void set_auto_tune(bool on) = 0;
+
+      // The samples in a full size frame of the MCS, as auto tuned
+      virtual int tuned_frame_len(void) = 0;
+
+      // The CPU time, in seconds, to make a full size frame, as auto tuned
+      virtual double tuned_frame_time(void) = 0;
+
+      // The minimum output buffer size in items that auto tuning set
+      virtual long tuned_buffer_items(void) = 0;
     };
 
   } // namespace liquidDSP
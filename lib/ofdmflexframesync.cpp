@@ -7,9 +7,12 @@
 #include <errno.h>
 #include <pthread.h>
 
-#include <iostream>
+#include <deque>
+#include <vector>
 
 #include <gnuradio/io_signature.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
 
 // Liquid-DSP docs:
 //
@@ -20,6 +23,14 @@
 #include "ofdmflexframesync.h"
 #include "debug.h"
 #include "common.h"
+#include "capture.h"
+#include "qpacketframe.h"
+#include "pipeline.h"
+#include "harq.h"
+#include "llr.h"
+#include "numerology.h"
+#include "mcs.h"
+#include "autotune.h"
 
 
 
@@ -36,25 +47,111 @@ frameSyncCallback(unsigned char *header, int header_valid,
                 unsigned char *payload, unsigned int payload_len,
                 int payload_valid, ::framesyncstats_s stats,
                 sync_impl *sync);
+
+static
+void
+qpacketFrameCallback(struct qpacketframe *frame, sync_impl *sync);
 }
 
 
 
+// The output state of one logical stream, that is one output port.
+struct stream {
+
+    int bytesOut;
+    int numLeftOverBytes;
+    uint8_t leftOverBytes[32];
+
+    uint8_t *outBuffer;
+
+    // The frame count of the last frame we wrote, so we can drop
+    // repeats of it when we do HARQ.
+    bool haveLastFrameCount;
+    uint64_t lastFrameCount;
+};
+
+
+// A frame that waits for room in the output buffers, for OUTPUT_LLR_*
+// or OUTPUT_FRAMES.
+struct pendingframe {
+
+    unsigned char header[HEADER_LEN];
+    unsigned int payload_len;
+    crc_scheme check;
+    fec_scheme fec0;
+    fec_scheme fec1;
+    modulation_scheme mod;
+    float evm;
+    float rssi;
+    float cfo;
+
+    // For OUTPUT_LLR_*
+    std::vector<float> llrs;
+    // For OUTPUT_FRAMES
+    std::vector<uint8_t> payload;
+};
+
+
 class sync_impl : public ofdmflexframesync {
 
     private:
         int d_in_item_sz;
         int d_out_item_sz;
-        int bytesOut;
-        int numLeftOverBytes;
-        uint8_t leftOverBytes[32];
+        int d_num_streams;
+        int d_framing;
+        int d_output;
+
+        std::vector<struct stream> streams;
 
-        uint8_t *outBuffer;
+        // Protects d_capture and d_harq from set_capture() and
+        // set_harq() while general_work() runs.
+        gr::thread::mutex d_mutex;
 
-        //gr::thread::mutex d_mutex;
+        // The shared subcarrier allocation and such.
+        const numerology *d_numerology;
 
-        unsigned char *subcarrierAlloc = 0;
+        // We have fs for FRAMING_FLEXFRAME or qs and d_pipeline for
+        // FRAMING_QPACKET.
         ::ofdmflexframesync fs = 0;
+        qpacketframesync *qs = 0;
+        pipeline *d_pipeline = 0;
+
+        // If set we capture input samples around frames.
+        capture *d_capture = 0;
+        bool d_captureAll = false;
+        // The capture sample number after the end of the frame that we
+        // are looking at, for capture::trigger().
+        uint64_t d_frameEnd = 0;
+
+        // If set we Chase combine repeated frames.
+        harq *d_harq = 0;
+        std::vector<uint8_t> harqPayload;
+
+        // For OUTPUT_LLR_* and OUTPUT_FRAMES, frames waiting for room in
+        // the output buffers.
+        llr demod;
+        std::deque<struct pendingframe> pendingFrames;
+        pmt::pmt_t llrTag;
+        pmt::pmt_t lengthTag;
+        // We drop frames with more LLRs than this.
+        static const int maxLlrsOut = 1 << 16;
+
+        // With d_autoTune the forecast is d_tunedFrameLen, the length of
+        // the last frame we got, which has d_tunedMode and a
+        // d_tunedPayloadLen byte payload.  The scheduler only reads the
+        // output buffer size at start(), so after d_started we just keep
+        // the numbers.
+        bool d_autoTune = false;
+        bool d_started = false;
+        size_t d_tunedFrameLen = 0;
+        struct scheme d_tunedMode;
+        unsigned int d_tunedPayloadLen = 0;
+        double d_tunedFrameTime = 0.0;
+        long d_tunedBufferItems = 0;
+
+        // The most input we run through qpacketframesync between checks
+        // that the pipeline is not full.
+        static const int pipelineStep = 4096;
 
         static const int maxBytesOut = 128;
         static const int maxBytesIn = (NUM_SUBCARRIERS+CP_LEN)*maxBytesOut*
@@ -62,15 +159,68 @@ class sync_impl : public ofdmflexframesync {
 
     public:
 
-        sync_impl(size_t in_item_sz);
+        sync_impl(size_t out_item_sz, int num_streams, int framing,
+                int decode_threads, int output,
+                const std::string &subcarriers);
+
+        int num_data_subcarriers(void) { return d_numerology->numData; }
         ~sync_impl();
 
-        // This needs to be a C function that is in effect part of this object.
+        // These need to be C functions that are in effect part of this
+        // object.
         friend int frameSyncCallback(unsigned char *header, int header_valid,
                 unsigned char *payload, unsigned int payload_len,
                 int payload_valid, framesyncstats_s stats,
                 sync_impl *sync);
+        friend void qpacketFrameCallback(struct qpacketframe *frame,
+                sync_impl *sync);
 
+        void gotFrame(const unsigned char *header, int header_valid,
+                const unsigned char *payload, unsigned int payload_len,
+                int payload_valid);
+
+        // Give a frame to d_harq.  Returns true if the payload was
+        // recovered into payload.
+        bool harqFrame(const unsigned char *header, int header_valid,
+                unsigned int payload_len, int payload_valid,
+                crc_scheme check, fec_scheme fec0, fec_scheme fec1,
+                modulation_scheme mod, const std::complex<float> *syms,
+                unsigned int num_syms, float evm, uint8_t *payload);
+
+        // Write the frames that the pipeline has decoded, in order, while
+        // there is room in the output buffers.
+        void drainPipeline(int noutput_items);
+
+        bool llrOutput(void) const {
+            return d_output == OUTPUT_LLR_FLOAT ||
+                d_output == OUTPUT_LLR_INT8;
+        }
+
+        // Compute the LLRs of a frame and queue it for drainPending().
+        void gotSoftFrame(const unsigned char *header, int header_valid,
+                unsigned int payload_len, crc_scheme check,
+                fec_scheme fec0, fec_scheme fec1, modulation_scheme mod,
+                const std::complex<float> *syms, unsigned int num_syms,
+                float rssi, float cfo);
+
+        // Write the queued frames, in order, while there is room in the
+        // output buffers.  Returns true if the queue is empty.
+        bool drainPending(int noutput_items);
+
+        void set_capture(const std::string &prefix, int capture_len,
+                bool all_frames, double min_interval);
+        void set_harq(int max_frames);
+        void set_auto_tune(bool on);
+        int tuned_frame_len(void) { return d_tunedFrameLen; }
+        double tuned_frame_time(void) { return d_tunedFrameTime; }
+        long tuned_buffer_items(void) { return d_tunedBufferItems; }
+
+        // Set d_tunedFrameLen from the header of a frame we got.  Call
+        // with d_mutex held.
+        void tuneFrame(unsigned int payload_len, crc_scheme check,
+                fec_scheme fec0, fec_scheme fec1, modulation_scheme mod);
+
+        bool start(void);
 
         void forecast (int noutput_items, gr_vector_int &ninput_items_required);
 
@@ -82,37 +232,91 @@ class sync_impl : public ofdmflexframesync {
 
 
 boost::shared_ptr<ofdmflexframesync>
-ofdmflexframesync::make(size_t out_item_sz) {
+ofdmflexframesync::make(size_t out_item_sz, int num_streams,
+        int framing, int decode_threads, int output,
+        const std::string &subcarriers) {
 
-    return gnuradio::get_initial_sptr(new sync_impl(out_item_sz));
+    return gnuradio::get_initial_sptr(
+            new sync_impl(out_item_sz, num_streams, framing,
+                decode_threads, output, subcarriers));
 }
 
 
 /*
  * The private constructor
  */
-sync_impl::sync_impl(size_t out_item_sz)
+sync_impl::sync_impl(size_t out_item_sz, int num_streams, int framing,
+        int decode_threads, int output, const std::string &subcarriers)
         : gr::block("ofdmflexframesync",
               gr::io_signature::make(1, 1, sizeof(std::complex<float>)),
-              gr::io_signature::make(1, 1, out_item_sz)),
+              gr::io_signature::make(num_streams, num_streams, out_item_sz)),
         d_in_item_sz (sizeof(std::complex<float>)),
         d_out_item_sz (out_item_sz),
-        numLeftOverBytes (0) {
+        d_num_streams (num_streams),
+        d_framing (framing),
+        d_output (output),
+        llrTag (pmt::intern("llr_frame")),
+        lengthTag (pmt::intern("packet_len")) {
+
+    INFO("liquid DSP VERSION: %s", liquid_version);
+
+    if(output != OUTPUT_FRAMES) {
+        ASSERT((d_in_item_sz % d_out_item_sz) == 0);
+        ASSERT(d_in_item_sz >= d_out_item_sz);
+    }
 
-    std::cerr << "liquid DSP VERSION: " << liquid_version << std::endl;
+    if(num_streams < 1 || num_streams > MAX_STREAMS)
+        throw std::invalid_argument("ofdmflexframesync num_streams"
+                " must be in the range [1, 256]");
+    if(framing != FRAMING_FLEXFRAME && framing != FRAMING_QPACKET)
+        throw std::invalid_argument("ofdmflexframesync unknown framing");
+    if(output == OUTPUT_LLR_FLOAT) {
+        if(out_item_sz != sizeof(float))
+            throw std::invalid_argument("ofdmflexframesync float LLR"
+                    " output needs float output items");
+    } else if(output == OUTPUT_LLR_INT8) {
+        if(out_item_sz != sizeof(int8_t))
+            throw std::invalid_argument("ofdmflexframesync int8 LLR"
+                    " output needs byte output items");
+    } else if(output != OUTPUT_BYTES && output != OUTPUT_FRAMES)
+        throw std::invalid_argument("ofdmflexframesync unknown output");
+
+    streams.resize(num_streams);
+    for(int i = 0; i < num_streams; ++i) {
+        streams[i].bytesOut = 0;
+        streams[i].numLeftOverBytes = 0;
+        streams[i].outBuffer = 0;
+        streams[i].haveLastFrameCount = false;
+        streams[i].lastFrameCount = 0;
+    }
 
-    ASSERT((d_in_item_sz % d_out_item_sz) == 0);
-    ASSERT(d_in_item_sz >= d_out_item_sz);
+    if(output == OUTPUT_BYTES)
+        set_relative_rate(0.005);
+    else if(output == OUTPUT_FRAMES)
+        // One item for a frame of about a thousand samples.
+        set_relative_rate(0.001);
+    else {
+        // Every payload symbol is some LLRs.
+        set_relative_rate(1.0);
+        set_min_output_buffer(maxLlrsOut);
+    }
 
-    set_relative_rate(0.005);
 
+    d_numerology = getNumerology(subcarriers);
 
-    subcarrierAlloc = (unsigned char *) malloc(NUM_SUBCARRIERS);
-    ASSERT(subcarrierAlloc, "malloc() failed");
-    ofdmframe_init_default_sctype(NUM_SUBCARRIERS, subcarrierAlloc);
+    if(framing == FRAMING_QPACKET) {
+        d_pipeline = new pipeline(decode_threads, 64, llrOutput());
+        qs = new qpacketframesync(d_numerology->M,
+                d_numerology->cp_len, d_numerology->taper_len,
+                d_numerology->p(),
+                (qpacketframe_callback) qpacketFrameCallback,
+                this/*callback data passed to qpacketFrameCallback()*/);
+        return;
+    }
 
-    fs = ofdmflexframesync_create(NUM_SUBCARRIERS, CP_LEN,
-            TAPER_LEN, subcarrierAlloc,
+    fs = ofdmflexframesync_create(d_numerology->M,
+            d_numerology->cp_len, d_numerology->taper_len,
+            d_numerology->p(),
             (framesync_callback) frameSyncCallback,
             this/*callback data passed to frameSyncCallback()*/);
     ASSERT(fs, "ofdmflexframesync_create() failed");
@@ -125,19 +329,188 @@ sync_impl::~sync_impl() {
         ofdmflexframesync_destroy(fs);
         fs = 0;
     }
-    if(subcarrierAlloc) {
-        free(subcarrierAlloc);
-        subcarrierAlloc = 0;
+    if(qs) {
+        delete qs;
+        qs = 0;
+    }
+    if(d_pipeline) {
+        delete d_pipeline;
+        d_pipeline = 0;
+    }
+    if(d_capture) {
+        delete d_capture;
+        d_capture = 0;
+    }
+    if(d_harq) {
+        delete d_harq;
+        d_harq = 0;
+    }
+
+    INFO("ofdmflexframesync destructor called");
+}
+
+
+void sync_impl::set_capture(const std::string &prefix, int capture_len,
+        bool all_frames, double min_interval) {
+
+    if(prefix.size() && capture_len <= 0)
+        throw std::invalid_argument("ofdmflexframesync capture_len"
+                " must be greater than 0");
+
+    capture *c = 0;
+    if(prefix.size())
+        c = new capture(prefix, capture_len, min_interval);
+
+    capture *old;
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        old = d_capture;
+        d_capture = c;
+        d_captureAll = all_frames;
     }
 
-    INFO("ofdmflexframesync destructor called");;
+    // This waits for the old capture files to be written.
+    if(old)
+        delete old;
+}
+
+
+void sync_impl::set_harq(int max_frames) {
+
+    if(max_frames < 0)
+        throw std::invalid_argument("ofdmflexframesync HARQ max_frames"
+                " must not be less than 0");
+
+    harq *h = 0;
+    if(max_frames)
+        h = new harq(max_frames);
+
+    harq *old;
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        old = d_harq;
+        d_harq = h;
+        for(int i = 0; i < d_num_streams; ++i)
+            streams[i].haveLastFrameCount = false;
+    }
+
+    if(old)
+        delete old;
+}
+
+
+bool sync_impl::start(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+    d_started = true;
+    return true;
+}
+
+
+void sync_impl::set_auto_tune(bool on) {
+
+    if(!on) {
+        gr::thread::scoped_lock guard(d_mutex);
+        d_autoTune = false;
+        return;
+    }
+
+    // We don't know what the generator sends until we get a frame, so
+    // we start with the generator's default MCS.  general_work() can go
+    // on while we time it with a synchronizer of our own.
+    const struct scheme *mode = getMode(getDefaultModes(), 5);
+    size_t frameLen = d_numerology->frameLength(d_framing, mode,
+            maxBytesOut);
+    double frameTime = timeFrameSync(d_numerology, d_framing, mode,
+            maxBytesOut);
+
+    long itemsPerFrame;
+    if(d_output == OUTPUT_FRAMES)
+        itemsPerFrame = 1;
+    else if(llrOutput())
+        // At most 8 LLRs for each data subcarrier of each OFDM symbol.
+        itemsPerFrame = 8*d_numerology->numData*frameLen/
+            (d_numerology->M + d_numerology->cp_len);
+    else
+        itemsPerFrame = maxBytesOut/d_out_item_sz;
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    d_autoTune = true;
+    d_tunedFrameLen = frameLen;
+    d_tunedMode = *mode;
+    d_tunedPayloadLen = maxBytesOut;
+    d_tunedFrameTime = frameTime;
+    d_tunedBufferItems = autotuneBufferFrames(frameTime)*itemsPerFrame;
+    if(llrOutput() && d_tunedBufferItems < maxLlrsOut)
+        d_tunedBufferItems = maxLlrsOut;
+
+    if(d_started) {
+        // Too late for the scheduler to see a new buffer size.
+        DSPEW("Auto tuned while running: frame %zu samples, %.1f usec;"
+                " output buffer unchanged", d_tunedFrameLen,
+                1.0e6*d_tunedFrameTime);
+        return;
+    }
+
+    set_min_output_buffer(d_tunedBufferItems);
+
+    DSPEW("Auto tuned: frame %zu samples, %.1f usec; output buffer %ld"
+            " items", d_tunedFrameLen, 1.0e6*d_tunedFrameTime,
+            d_tunedBufferItems);
+}
+
+
+void sync_impl::tuneFrame(unsigned int payload_len, crc_scheme check,
+        fec_scheme fec0, fec_scheme fec1, modulation_scheme mod) {
+
+    // The payload length comes off the air, and can be up to 65535.  We
+    // only need the length of the frames the generator sends, so we keep
+    // the key of the numerology's length cache small, since a new key
+    // makes a whole frame here in general_work().
+    if(payload_len > maxBytesOut)
+        payload_len = maxBytesOut;
+
+    if(payload_len == d_tunedPayloadLen && mod == d_tunedMode.mod &&
+            fec0 == d_tunedMode.fec0 && fec1 == d_tunedMode.fec1 &&
+            check == d_tunedMode.check)
+        // Same as the last frame.
+        return;
+
+    d_tunedMode.mode = 0;
+    d_tunedMode.mod = mod;
+    d_tunedMode.fec0 = fec0;
+    d_tunedMode.fec1 = fec1;
+    d_tunedMode.check = check;
+    d_tunedPayloadLen = payload_len;
+    d_tunedFrameLen = d_numerology->frameLength(d_framing, &d_tunedMode,
+            payload_len);
 }
 
 
 void sync_impl::forecast(int noutput_items,
         gr_vector_int &ninput_items_required) {
 
-    ninput_items_required[0] = 1024;
+    gr::thread::scoped_lock guard(d_mutex);
+
+    if((d_pipeline && !d_pipeline->empty()) || pendingFrames.size()) {
+        // We have frames to write, which must not wait for more input.
+        ninput_items_required[0] = 0;
+        return;
+    }
+
+    if(!d_autoTune) {
+        ninput_items_required[0] = 1024;
+        return;
+    }
+
+    // A whole frame, but no more than half the input buffer, or we
+    // could wait for more than it can ever have.
+    int n = d_tunedFrameLen;
+    int maxIn = detail()->input(0)->buffer()->bufsize()/2;
+    if(n > maxIn) n = maxIn;
+    if(n < 1) n = 1;
+    ninput_items_required[0] = n;
 }
 
 
@@ -147,99 +520,456 @@ int sync_impl::general_work(int noutput_items,
         gr_vector_void_star &output_items) {
 
 
-    outBuffer = (uint8_t *) output_items[0];
+    // Protect d_capture from set_capture()
+    gr::thread::scoped_lock guard(d_mutex);
 
-    ofdmflexframesync_execute(fs,
-            (std::complex<float> *) input_items[0],
-            ninput_items[0]);
+    // frameSyncCallback() may be called any number of times from
+    // ofdmflexframesync_execute(), and it adds to the output of the
+    // stream of each frame it gets.
+    for(int i = 0; i < d_num_streams; ++i) {
+        streams[i].outBuffer = (uint8_t *) output_items[i];
+        streams[i].bytesOut = 0;
+    }
 
-    consume_each(ninput_items[0]);
+    if(d_output != OUTPUT_BYTES && !drainPending(noutput_items)) {
+        // We still have frames from before that don't fit, so we don't
+        // take more input until there is room.
+        consume_each(0);
+        for(int i = 0; i < d_num_streams; ++i)
+            produce(i, streams[i].bytesOut/d_out_item_sz);
+        return WORK_CALLED_PRODUCE;
+    }
 
-    ASSERT(bytesOut/d_out_item_sz <= noutput_items);
+    std::complex<float> *in = (std::complex<float> *) input_items[0];
+    int ninput = ninput_items[0];
+
+    // When we capture we run the synchronizer on steps of a quarter of
+    // the capture length, so we know where a frame ends to within that,
+    // and the capture has the end of the frame in it.  With the pipeline
+    // we take steps of at most pipelineStep, so we can stop when it is
+    // full.
+    int step = ninput;
+    if(d_capture) {
+        step = d_capture->length()/4;
+        if(step < 1) step = 1;
+    }
+    if(qs && step > pipelineStep)
+        step = pipelineStep;
+
+    if(qs && ninput == 0)
+        // The forecast lets us in with no input when the pipeline has
+        // frames, so we wait for the next one to write it.
+        d_pipeline->waitFront();
+
+    int i;
+    for(i = 0; i < ninput; i += step) {
+        if(qs && d_pipeline->full()) {
+            // We wait for a frame to be decoded and write what we can.
+            d_pipeline->waitFront();
+            drainPipeline(noutput_items);
+            if(d_pipeline->full())
+                // There is no room for the decoded frames, so we take
+                // no more input.
+                break;
+        }
+        int n = ninput - i;
+        if(n > step) n = step;
+        if(d_capture) {
+            d_capture->write(in + i, n);
+            d_frameEnd = d_capture->numSamples();
+        }
+        // For qpacketframe this does the detection and the headers, and
+        // gives the payloads to the pipeline.
+        if(qs)
+            qs->execute(in + i, n);
+        else
+            ofdmflexframesync_execute(fs, in + i, n);
+    }
+
+    if(qs)
+        // We write the payloads that the pipeline has finished decoding
+        // so far.
+        drainPipeline(noutput_items);
+
+    if(d_output != OUTPUT_BYTES)
+        drainPending(noutput_items);
+
+    consume_each(i < ninput ? i : ninput);
 
-    return bytesOut/d_out_item_sz;
+    for(int i = 0; i < d_num_streams; ++i) {
+        ASSERT(streams[i].bytesOut/d_out_item_sz <= noutput_items);
+        produce(i, streams[i].bytesOut/d_out_item_sz);
+    }
+
+    return WORK_CALLED_PRODUCE;
 }
 
 
 
 
-extern "C" {
+void sync_impl::drainPipeline(int noutput_items) {
+
+    struct pipelineframe *f;
+
+    while((f = d_pipeline->front())) {
+
+        const struct qpacketframe *h = &f->frame;
+        d_frameEnd = f->sample;
+
+        if(llrOutput()) {
+            // The worker computed the LLRs.  We don't need to check for
+            // room, because drainPending() writes them.
+            if(h->header_valid && f->llrs.size()) {
+                if(d_capture && d_captureAll)
+                    d_capture->trigger(getHeaderFrameCount(h->header),
+                            "soft", d_frameEnd);
+                pendingFrames.emplace_back();
+                struct pendingframe *sf = &pendingFrames.back();
+                memcpy(sf->header, h->header, HEADER_LEN);
+                sf->payload_len = h->payload_len;
+                sf->check = h->check;
+                sf->fec0 = h->fec0;
+                sf->fec1 = h->fec1;
+                sf->mod = h->mod;
+                sf->evm = f->evm;
+                sf->rssi = h->rssi;
+                sf->cfo = h->cfo;
+                sf->llrs.swap(f->llrs);
+            }
+            d_pipeline->pop();
+            continue;
+        }
+
+        if(d_harq && harqFrame(h->header, h->header_valid,
+                    h->payload_len, f->payload_valid, h->check, h->fec0,
+                    h->fec1, h->mod, f->syms.data(), f->syms.size(),
+                    f->evm, f->payload.data()))
+            // We set payload_valid so we don't combine this try again
+            // if there is no room to write it now.
+            f->payload_valid = 1;
+
+        if(d_output == OUTPUT_BYTES && h->header_valid &&
+                f->payload_valid) {
+            uint32_t streamId = getHeaderStreamId(h->header);
+            if(streamId < (uint32_t) d_num_streams) {
+                struct stream *s = &streams[streamId];
+                if(s->bytesOut + s->numLeftOverBytes + f->payload.size() >
+                        (size_t) noutput_items*d_out_item_sz)
+                    // No room.  We'll write it in the next call.  For
+                    // OUTPUT_FRAMES gotFrame() queues it.
+                    return;
+            }
+        }
+
+        gotFrame(h->header, h->header_valid, f->payload.data(),
+                f->payload.size(), f->payload_valid);
+        d_pipeline->pop();
+    }
+}
 
-static
-int
-frameSyncCallback(unsigned char *header, int header_valid,
-                unsigned char *payload, unsigned int payload_len,
-                int payload_valid, ::framesyncstats_s stats,
-                sync_impl *sync) {
+
+void sync_impl::gotSoftFrame(const unsigned char *header,
+        int header_valid, unsigned int payload_len, crc_scheme check,
+        fec_scheme fec0, fec_scheme fec1, modulation_scheme mod,
+        const std::complex<float> *syms, unsigned int num_syms,
+        float rssi, float cfo) {
+
+    if(!header_valid || !num_syms) return;
+
+    if(d_capture && d_captureAll)
+        d_capture->trigger(getHeaderFrameCount(header), "soft",
+                d_frameEnd);
+
+    pendingFrames.emplace_back();
+    struct pendingframe *sf = &pendingFrames.back();
+    memcpy(sf->header, header, HEADER_LEN);
+    sf->payload_len = payload_len;
+    sf->check = check;
+    sf->fec0 = fec0;
+    sf->fec1 = fec1;
+    sf->mod = mod;
+    sf->rssi = rssi;
+    sf->cfo = cfo;
+    sf->evm = demod.demodulate(mod, syms, num_syms, sf->llrs);
+}
+
+
+bool sync_impl::drainPending(int noutput_items) {
+
+    while(pendingFrames.size()) {
+
+        struct pendingframe *sf = &pendingFrames.front();
+        uint32_t streamId = getHeaderStreamId(sf->header);
+        // The number of output items of the frame.
+        int n = 1;
+        if(llrOutput())
+            n = sf->llrs.size();
+
+        if(streamId >= (uint32_t) d_num_streams) {
+            DSPEW("Dropping frame with stream ID %" PRIu32, streamId);
+            pendingFrames.pop_front();
+            continue;
+        }
+        if(n > maxLlrsOut) {
+            WARN("Dropping frame with %d LLRs", n);
+            pendingFrames.pop_front();
+            continue;
+        }
+
+        struct stream *s = &streams[streamId];
+        int itemsOut = s->bytesOut/d_out_item_sz;
+
+        if(itemsOut + n > noutput_items)
+            // No room.  We'll write it in the next call.
+            return false;
+
+        if(d_output == OUTPUT_FRAMES) {
+            // One item, the payload padded with zeros, tagged with the
+            // payload length.
+            add_item_tag(streamId, nitems_written(streamId) + itemsOut,
+                    lengthTag, pmt::from_long(sf->payload.size()));
+            memcpy(s->outBuffer, sf->payload.data(), sf->payload.size());
+            memset(s->outBuffer + sf->payload.size(), 0,
+                    d_out_item_sz - sf->payload.size());
+            s->bytesOut += d_out_item_sz;
+            s->outBuffer += d_out_item_sz;
+            pendingFrames.pop_front();
+            continue;
+        }
+
+        pmt::pmt_t meta = pmt::make_dict();
+        meta = pmt::dict_add(meta, pmt::intern("frame_count"),
+                pmt::from_uint64(getHeaderFrameCount(sf->header)));
+        meta = pmt::dict_add(meta, pmt::intern("stream_id"),
+                pmt::from_long(streamId));
+        meta = pmt::dict_add(meta, pmt::intern("payload_len"),
+                pmt::from_long(sf->payload_len));
+        meta = pmt::dict_add(meta, pmt::intern("mod"),
+                pmt::intern(modulation_types[sf->mod].name));
+        meta = pmt::dict_add(meta, pmt::intern("fec0"),
+                pmt::intern(fec_scheme_str[sf->fec0][0]));
+        meta = pmt::dict_add(meta, pmt::intern("fec1"),
+                pmt::intern(fec_scheme_str[sf->fec1][0]));
+        meta = pmt::dict_add(meta, pmt::intern("crc"),
+                pmt::intern(crc_scheme_str[sf->check][0]));
+        meta = pmt::dict_add(meta, pmt::intern("num_llrs"),
+                pmt::from_long(n));
+        meta = pmt::dict_add(meta, pmt::intern("evm"),
+                pmt::from_double(sf->evm));
+        meta = pmt::dict_add(meta, pmt::intern("rssi"),
+                pmt::from_double(sf->rssi));
+        meta = pmt::dict_add(meta, pmt::intern("cfo"),
+                pmt::from_double(sf->cfo));
+        add_item_tag(streamId, nitems_written(streamId) + itemsOut,
+                llrTag, meta);
+
+        if(d_output == OUTPUT_LLR_FLOAT)
+            memcpy(s->outBuffer, sf->llrs.data(), n*sizeof(float));
+        else
+            llr::quantize(sf->llrs.data(), n, (int8_t *) s->outBuffer);
+
+        s->bytesOut += n*d_out_item_sz;
+        s->outBuffer += n*d_out_item_sz;
+        pendingFrames.pop_front();
+    }
+
+    return true;
+}
+
+
+bool sync_impl::harqFrame(const unsigned char *header, int header_valid,
+        unsigned int payload_len, int payload_valid,
+        crc_scheme check, fec_scheme fec0, fec_scheme fec1,
+        modulation_scheme mod, const std::complex<float> *syms,
+        unsigned int num_syms, float evm, uint8_t *payload) {
+
+    if(!header_valid || !payload_len || !num_syms) return false;
+
+    if(getHeaderFrameCount(header) == FROZEN_FRAME_COUNT)
+        // Different frames from the generator's frame cache.
+        return false;
+
+    if(payload_valid) {
+        d_harq->forget(header);
+        return false;
+    }
+
+    uint32_t streamId = getHeaderStreamId(header);
+    if(streamId < (uint32_t) d_num_streams &&
+            streams[streamId].haveLastFrameCount &&
+            streams[streamId].lastFrameCount ==
+                getHeaderFrameCount(header))
+        // It's a repeat of a frame we already have.
+        return false;
+
+    return d_harq->combine(header, payload_len, check, fec0, fec1, mod,
+            syms, num_syms, evm, payload);
+}
 
 
-    // Initialize for each call.  The bytes out for each call.
-    sync->bytesOut = 0;
+// Called with each frame that we get from the synchronizer.
+void sync_impl::gotFrame(const unsigned char *header, int header_valid,
+        const unsigned char *payload, unsigned int payload_len,
+        int payload_valid) {
 
+    if(d_capture && header_valid &&
+            (!payload_valid || d_captureAll))
+        d_capture->trigger(getHeaderFrameCount(header),
+                payload_valid?"valid":"payload_invalid", d_frameEnd);
 
-    if(payload_len <= 0 || !payload_valid) return 0;
+    if(payload_len <= 0 || !header_valid || !payload_valid) return;
+
+    uint32_t streamId = getHeaderStreamId(header);
+
+    if(streamId >= (uint32_t) d_num_streams) {
+        DSPEW("Dropping frame with stream ID %" PRIu32, streamId);
+        return;
+    }
+
+    struct stream *s = &streams[streamId];
+
+    uint64_t frameCount = getHeaderFrameCount(header);
+    if(d_harq && frameCount != FROZEN_FRAME_COUNT) {
+        // The generator sends each frame more than once, and we only
+        // want one of them.
+        if(s->haveLastFrameCount && s->lastFrameCount == frameCount)
+            return;
+        s->haveLastFrameCount = true;
+        s->lastFrameCount = frameCount;
+    }
+
+    if(d_output == OUTPUT_FRAMES) {
+        if(payload_len > (unsigned int) d_out_item_sz) {
+            WARN("Dropping %u byte frame that is longer than the %d"
+                    " byte output items", payload_len, d_out_item_sz);
+            return;
+        }
+        pendingFrames.emplace_back();
+        struct pendingframe *f = &pendingFrames.back();
+        memcpy(f->header, header, HEADER_LEN);
+        f->payload.assign(payload, payload + payload_len);
+        return;
+    }
 
     // In GNUradio stream buffers we can't write partial output types.
     // So, like if the output is floats we can't write 2 bytes, we have to
     // write in units of sizeof(float) which is 4 bytes.  It is possible
-    // that we have to store some data in sync->leftOverBytes for a future
+    // that we have to store some data in s->leftOverBytes for a future
     // call to this callback.
     //
-    if(payload_len + sync->numLeftOverBytes < sync->d_out_item_sz) {
+    if(payload_len + s->numLeftOverBytes < d_out_item_sz) {
         //
         // We can't write yet.  We do not have a full size of an output
-        // type.  We store the data in sync.leftOverBytes for a later
+        // type.  We store the data in s->leftOverBytes for a later
         // call to this function.
         //
-        memcpy(sync->leftOverBytes + sync->numLeftOverBytes,
+        memcpy(s->leftOverBytes + s->numLeftOverBytes,
                 payload, payload_len);
-        sync->numLeftOverBytes += payload_len;
-        return 0;
+        s->numLeftOverBytes += payload_len;
+        return;
     }
 
-    if(sync->numLeftOverBytes) {
+    if(s->numLeftOverBytes) {
         //
         // Write older saved bytes to the output.  The "if" above shows that
         // now we have enough data to write some output.  First write this
         // old data.
         //
         //DSPEW();
-        memcpy(sync->outBuffer, sync->leftOverBytes, sync->numLeftOverBytes);
-        sync->bytesOut += sync->numLeftOverBytes;
-        sync->outBuffer += sync->numLeftOverBytes;
+        memcpy(s->outBuffer, s->leftOverBytes, s->numLeftOverBytes);
+        s->bytesOut += s->numLeftOverBytes;
+        s->outBuffer += s->numLeftOverBytes;
     }
 
-    if((payload_len + sync->numLeftOverBytes) % sync->d_out_item_sz) {
+    if((payload_len + s->numLeftOverBytes) % d_out_item_sz) {
         //
         // We need to save some left over bytes for a later call.  We
         // cannot write them now because that would make it not an even
         // number of output types; and GNU radio cannot handle that.
         //
-        sync->numLeftOverBytes = (payload_len + sync->numLeftOverBytes) %
-            sync->d_out_item_sz;
-        uint8_t *from = payload + payload_len - sync->numLeftOverBytes;
-        memcpy(sync->leftOverBytes, from, sync->numLeftOverBytes);
-        payload_len -= sync->numLeftOverBytes;
-        //DSPEW("sync->numLeftOverBytes=%d", sync->numLeftOverBytes);
+        s->numLeftOverBytes = (payload_len + s->numLeftOverBytes) %
+            d_out_item_sz;
+        const uint8_t *from = payload + payload_len - s->numLeftOverBytes;
+        memcpy(s->leftOverBytes, from, s->numLeftOverBytes);
+        payload_len -= s->numLeftOverBytes;
+        //DSPEW("s->numLeftOverBytes=%d", s->numLeftOverBytes);
 
     } else {
         // We no longer have left over bytes.  Let it be known for the
         // next call.
-        sync->numLeftOverBytes = 0;
-        //DSPEW("sync->numLeftOverBytes=0");
+        s->numLeftOverBytes = 0;
+        //DSPEW("s->numLeftOverBytes=0");
     }
 
 
-    memcpy(sync->outBuffer, payload, payload_len);
+    memcpy(s->outBuffer, payload, payload_len);
 
-    sync->bytesOut += payload_len;
+    s->bytesOut += payload_len;
+    s->outBuffer += payload_len;
 
     // This must be true.  We only write out a multiple of the output
     // type.  That's what all this bullshit code above was for.
-    DASSERT(sync->bytesOut % sync->d_out_item_sz == 0);
+    DASSERT(s->bytesOut % d_out_item_sz == 0);
+}
+
+
+extern "C" {
 
+static
+int
+frameSyncCallback(unsigned char *header, int header_valid,
+                unsigned char *payload, unsigned int payload_len,
+                int payload_valid, ::framesyncstats_s stats,
+                sync_impl *sync) {
+
+    if(sync->d_autoTune && header_valid)
+        sync->tuneFrame(payload_len, (crc_scheme) stats.check,
+                (fec_scheme) stats.fec0, (fec_scheme) stats.fec1,
+                (modulation_scheme) stats.mod_scheme);
+
+    // The liquid synchronizer gives us the equalized payload symbols in
+    // stats.framesyms.
+    if(sync->llrOutput()) {
+        sync->gotSoftFrame(header, header_valid, payload_len,
+                (crc_scheme) stats.check, (fec_scheme) stats.fec0,
+                (fec_scheme) stats.fec1,
+                (modulation_scheme) stats.mod_scheme,
+                stats.framesyms, stats.num_framesyms, stats.rssi,
+                stats.cfo);
+        return 0;
+    }
+
+    if(sync->d_harq) {
+        sync->harqPayload.resize(payload_len);
+        if(sync->harqFrame(header, header_valid, payload_len,
+                    payload_valid, (crc_scheme) stats.check,
+                    (fec_scheme) stats.fec0, (fec_scheme) stats.fec1,
+                    (modulation_scheme) stats.mod_scheme,
+                    stats.framesyms, stats.num_framesyms, stats.evm,
+                    sync->harqPayload.data())) {
+            payload = sync->harqPayload.data();
+            payload_valid = 1;
+        }
+    }
+
+    sync->gotFrame(header, header_valid, payload, payload_len,
+            payload_valid);
     return 0;
 }
+
+
+static
+void
+qpacketFrameCallback(struct qpacketframe *frame, sync_impl *sync) {
+
+    if(sync->d_autoTune && frame->header_valid)
+        sync->tuneFrame(frame->payload_len, frame->check, frame->fec0,
+                frame->fec1, frame->mod);
+
+    // The payload is decoded by the pipeline worker threads.
+    if(!sync->d_pipeline->push(frame, sync->d_frameEnd))
+        WARN("Dropping a frame, the decoder pipeline is full");
+}
 } // extern "c" {
 
 
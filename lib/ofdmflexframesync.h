@@ -1,3 +1,5 @@
+#include <string>
+
 #include <gnuradio/block.h>
 #include <gnuradio/attributes.h>
 
@@ -23,9 +25,98 @@ namespace gr {
       /*!
        * \brief Return a shared_ptr to a new instance of
        * liquidDSP::ofdmflexframesync.
+       *
+       * \param out_item_sz size of the output stream items in bytes
+       * \param num_streams number of output ports.  Payloads are written
+       *                    to the output port that is the stream ID in
+       *                    the frame header, and frames with a stream ID
+       *                    that is not less than num_streams are dropped.
+       * \param framing     0 for liquid ofdmflexframe frames, or 1 for
+       *                    qpacketframe frames, which this decodes with a
+       *                    pipeline: detection and equalization are done in
+       *                    the block's thread and demodulation and FEC
+       *                    decoding in decode_threads worker threads.  The
+       *                    generator must use the same framing.
+       * \param decode_threads number of pipeline worker threads, 0 for one
+       *                    per CPU.
+       * \param output      0 for the decoded payload bytes, or the LLRs
+       *                    of the encoded payload bits as 1 float or 2
+       *                    int8 items, for a decoder downstream.  Only
+       *                    with qpacketframe framing (1) does that save
+       *                    the payload decoding; liquid's ofdmflexframe
+       *                    synchronizer (0) still decodes every payload
+       *                    itself.  The first LLR of each frame has an
+       *                    "llr_frame" tag with a dict of the frame count,
+       *                    stream ID, payload length, liquid modulation,
+       *                    FEC and CRC scheme names, number of LLRs, EVM,
+       *                    RSSI and CFO.  See lib/llr.h.
+       *                    Or 3 for one output item for each payload:
+       *                    out_item_sz is then the vector length in bytes,
+       *                    the payload is padded with zeros, and the item
+       *                    has a "packet_len" tag with the payload length.
+       *                    Longer payloads are dropped.
+       * \param subcarriers the subcarrier allocation, which must be the
+       *                    same as the generator's; see
+       *                    ofdmflexframegen::make().
        */
       static boost::shared_ptr<ofdmflexframesync>
-          make(size_t out_item_sz);
+          make(size_t out_item_sz, int num_streams = 1, int framing = 0,
+                  int decode_threads = 0, int output = 0,
+                  const std::string &subcarriers = "");
+
+      // Returns the number of data subcarriers in the allocation
+      virtual int num_data_subcarriers(void) = 0;
+
+      /*!
+       * \brief Capture the input samples around frames to files.
+       *
+       * A ring buffer keeps the last capture_len input samples, and they
+       * are written to a file by a background thread when a frame with
+       * a valid header and an invalid payload is found, or when any
+       * frame is found if all_frames is set.  There is at most one
+       * capture every min_interval seconds.  An empty prefix turns
+       * capturing off.  See lib/capture.h for the file names.
+       */
+      virtual void set_capture(const std::string &prefix,
+              int capture_len = 1 << 16, bool all_frames = false,
+              double min_interval = 1.0) = 0;
+
+      /*!
+       * \brief Chase combine frames that are sent more than once.
+       *
+       * With max_frames greater than 0, the payload symbols of frames
+       * with a valid header and a bad payload are kept for up to
+       * max_frames frames, and combined with later tries of the same
+       * frame, which the generator sends with set_harq_repeats().
+       * Repeats of a frame that we already have are dropped.  0 turns
+       * it off.  This does nothing if we output LLRs.  See lib/harq.h.
+       */
+      virtual void set_harq(int max_frames) = 0;
+
+      /*!
+       * \brief Size the input forecast and the output buffer from the
+       * measured frame length and frame CPU time.
+       *
+       * When it is on, the block measures a full size frame of MCS 5 of
+       * the built in MCS table now, and then takes the frame length from
+       * the header of each frame it gets.  The forecast asks for one
+       * whole frame of input, and the minimum output buffer holds the
+       * output of enough frames to cover a couple of milliseconds of
+       * work.  The buffer size only takes effect if this is called
+       * before the flowgraph starts; later the block only measures.  See
+       * lib/autotune.h.
+       */
+      virtual void set_auto_tune(bool on) = 0;
+
+      // The samples in the last frame, as auto tuned
+      virtual int tuned_frame_len(void) = 0;
+
+      // The CPU time, in seconds, to synchronize to a full size frame,
+      // as auto tuned
+      virtual double tuned_frame_time(void) = 0;
+
+      // The minimum output buffer size in items that auto tuning set
+      virtual long tuned_buffer_items(void) = 0;
     };
 
   } // namespace liquidDSP
@@ -0,0 +1,186 @@
+#include <string.h>
+#include <errno.h>
+
+#include <liquid.h>
+
+#include "pipeline.h"
+#include "llr.h"
+#include "debug.h"
+
+
+
+pipeline::pipeline(int nthreads, int maxFrames_in, bool soft_in):
+    pushSeq(0),
+    popSeq(0),
+    numInFlight(0),
+    maxFrames(maxFrames_in),
+    soft(soft_in),
+    running(true) {
+
+    if(nthreads <= 0)
+        nthreads = gr::thread::thread::hardware_concurrency();
+    if(nthreads <= 0)
+        nthreads = 1;
+    ASSERT(maxFrames > 0);
+
+    for(int i = 0; i < nthreads; ++i)
+        threads.create_thread([this]() { worker(); });
+
+    DSPEW("Started %d frame decoder threads", nthreads);
+}
+
+
+pipeline::~pipeline() {
+
+    {
+        gr::thread::scoped_lock guard(d_mutex);
+        running = false;
+        d_workCond.notify_all();
+    }
+    threads.join_all();
+
+    for(size_t i = 0; i < queue.size(); ++i)
+        delete queue[i];
+    std::map<uint64_t, struct pipelineframe *>::iterator it;
+    for(it = done.begin(); it != done.end(); ++it)
+        delete it->second;
+    for(size_t i = 0; i < freeFrames.size(); ++i)
+        delete freeFrames[i];
+}
+
+
+bool pipeline::push(const struct qpacketframe *frame, uint64_t sample) {
+
+    struct pipelineframe *f;
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    // The caller checks full() between runs of the synchronizer, and a
+    // run can find more than one frame, so we leave some room past
+    // maxFrames before we refuse.
+    if(numInFlight >= 2*maxFrames)
+        return false;
+
+    if(freeFrames.size()) {
+        f = freeFrames.back();
+        freeFrames.pop_back();
+    } else
+        f = new struct pipelineframe;
+
+    f->seq = pushSeq++;
+    f->sample = sample;
+    f->frame = *frame;
+    f->syms.assign(frame->syms, frame->syms + frame->num_syms);
+    f->frame.syms = 0;
+    f->payload.clear();
+    f->payload_valid = 0;
+    f->evm = 0.0f;
+    f->llrs.clear();
+
+    queue.push_back(f);
+    ++numInFlight;
+    d_workCond.notify_one();
+    return true;
+}
+
+
+struct pipelineframe *pipeline::front(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    std::map<uint64_t, struct pipelineframe *>::iterator it =
+        done.find(popSeq);
+    if(it == done.end())
+        return 0;
+    return it->second;
+}
+
+
+void pipeline::pop(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    std::map<uint64_t, struct pipelineframe *>::iterator it =
+        done.find(popSeq);
+    ASSERT(it != done.end());
+    freeFrames.push_back(it->second);
+    done.erase(it);
+    ++popSeq;
+    --numInFlight;
+}
+
+
+bool pipeline::full(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+    return numInFlight >= maxFrames;
+}
+
+
+bool pipeline::empty(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+    return numInFlight == 0;
+}
+
+
+void pipeline::waitFront(void) {
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    while(numInFlight && done.find(popSeq) == done.end())
+        d_doneCond.wait(guard);
+}
+
+
+void pipeline::worker(void) {
+
+    // Each worker keeps its own payload decoder, and only reconfigures it
+    // when the payload properties change.
+    qpacketmodem q = qpacketmodem_create();
+    ASSERT(q, "qpacketmodem_create() failed");
+    struct qpacketframe last;
+    memset(&last, 0, sizeof(last));
+    llr demod;
+
+    gr::thread::scoped_lock guard(d_mutex);
+
+    while(true) {
+
+        while(running && queue.empty())
+            d_workCond.wait(guard);
+        if(!running) break;
+
+        struct pipelineframe *f = queue.front();
+        queue.pop_front();
+
+        guard.unlock();
+
+        const struct qpacketframe *h = &f->frame;
+
+        if(h->header_valid && soft)
+            f->evm = demod.demodulate(h->mod, f->syms.data(),
+                    f->syms.size(), f->llrs);
+        else if(h->header_valid) {
+            if(h->payload_len != last.payload_len ||
+                    h->check != last.check || h->fec0 != last.fec0 ||
+                    h->fec1 != last.fec1 || h->mod != last.mod) {
+                qpacketmodem_configure(q, h->payload_len, h->check,
+                        h->fec0, h->fec1, h->mod);
+                last = *h;
+            }
+            DASSERT(f->syms.size() == qpacketmodem_get_frame_len(q));
+            f->payload.resize(h->payload_len);
+            f->payload_valid = qpacketmodem_decode(q, f->syms.data(),
+                    f->payload.data());
+            f->evm = qpacketmodem_get_demodulator_evm(q);
+        }
+
+        guard.lock();
+
+        done[f->seq] = f;
+        d_doneCond.notify_one();
+    }
+
+    qpacketmodem_destroy(q);
+}
@@ -0,0 +1,100 @@
+#ifndef __pipeline_h__
+#define __pipeline_h__
+
+#include <stdint.h>
+
+#include <complex>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <gnuradio/thread/thread.h>
+#include <gnuradio/thread/thread_group.h>
+
+#include "qpacketframe.h"
+
+
+// A frame that the pipeline decodes.
+struct pipelineframe {
+
+    uint64_t seq;
+
+    // The sample number from push()
+    uint64_t sample;
+
+    // From qpacketframesync
+    struct qpacketframe frame;
+    std::vector<std::complex<float> > syms;
+
+    // From the decoder worker thread.  The payload is only set if the
+    // header is valid.
+    std::vector<uint8_t> payload;
+    int payload_valid;
+    float evm;
+
+    // With soft set, the worker sets the LLRs of the payload bits (see
+    // llr.h) and evm, and does not decode the payload.
+    std::vector<float> llrs;
+};
+
+
+// pipeline decodes the payloads of the frames from a qpacketframesync
+// with a pool of worker threads, so the thread that runs the synchronizer
+// only does detection, equalization and the header.  Frames come out of
+// front() in the order they went into push().
+//
+class pipeline {
+
+    public:
+
+        // If soft is set the workers only compute payload LLRs.
+        pipeline(int nthreads, int maxFrames = 64, bool soft = false);
+        ~pipeline();
+
+        // Copy a frame from a qpacketframesync callback into the
+        // pipeline.  Frames with invalid headers go through too, so the
+        // caller sees all frames in order.  This does not wait, because
+        // the caller is the one that pops frames; the caller stops
+        // pushing when full() is true.  If the caller pushes anyway,
+        // this refuses the frame and returns false once there are
+        // 2*maxFrames in the pipeline.  sample is for the caller, who
+        // gets it back in the pipelineframe.
+        bool push(const struct qpacketframe *frame, uint64_t sample = 0);
+
+        // Returns the next decoded frame, or 0 if it is not done yet.
+        // Call pop() when you are done with it.
+        struct pipelineframe *front(void);
+        void pop(void);
+
+        // A frame is in the pipeline from push() until pop().  full() is
+        // true when there are maxFrames or more of them.
+        bool full(void);
+        bool empty(void);
+
+        // Waits until the next frame is decoded, if there is one.
+        void waitFront(void);
+
+    private:
+
+        void worker(void);
+
+        gr::thread::mutex d_mutex;
+        gr::thread::condition_variable d_workCond;
+        gr::thread::condition_variable d_doneCond;
+
+        std::deque<struct pipelineframe *> queue;
+        std::map<uint64_t, struct pipelineframe *> done;
+        std::vector<struct pipelineframe *> freeFrames;
+
+        uint64_t pushSeq;
+        uint64_t popSeq;
+        int numInFlight;
+        int maxFrames;
+        bool soft;
+        bool running;
+
+        gr::thread::thread_group threads;
+};
+
+
+#endif // #ifndef __pipeline_h__
@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <liquid.h>
+
+#include "qpacketframe.h"
+#include "debug.h"
+
+
+
+static unsigned int countDataSubcarriers(unsigned int M,
+        const unsigned char *p) {
+
+    unsigned int n = 0;
+    for(unsigned int i = 0; i < M; ++i)
+        if(p[i] == OFDMFRAME_SCTYPE_DATA) ++n;
+    return n;
+}
+
+
+static qpacketmodem createHeaderModem(void) {
+
+    qpacketmodem q = qpacketmodem_create();
+    ASSERT(q, "qpacketmodem_create() failed");
+    qpacketmodem_configure(q, QPACKETFRAME_H_LEN, QPACKETFRAME_H_CRC,
+            QPACKETFRAME_H_FEC0, QPACKETFRAME_H_FEC1, QPACKETFRAME_H_MOD);
+    return q;
+}
+
+
+
+qpacketframegen::qpacketframegen(unsigned int M_in, unsigned int cp_len_in,
+        unsigned int taper_len_in, unsigned char *p_in,
+        const ofdmflexframegenprops_s *props_in):
+    M(M_in),
+    cp_len(cp_len_in),
+    taper_len(taper_len_in),
+    payloadModemLen(0),
+    numWritten(0) {
+
+    p = (unsigned char *) malloc(M);
+    ASSERT(p, "malloc() failed");
+    memcpy(p, p_in, M);
+    numData = countDataSubcarriers(M, p);
+    ASSERT(numData > 0);
+
+    fg = ofdmframegen_create(M, cp_len, taper_len, p);
+    ASSERT(fg, "ofdmframegen_create() failed");
+
+    headerModem = createHeaderModem();
+    payloadModem = qpacketmodem_create();
+    ASSERT(payloadModem, "qpacketmodem_create() failed");
+
+    setprops(props_in);
+}
+
+
+qpacketframegen::~qpacketframegen() {
+
+    qpacketmodem_destroy(payloadModem);
+    qpacketmodem_destroy(headerModem);
+    ofdmframegen_destroy(fg);
+    free(p);
+}
+
+
+void qpacketframegen::setprops(const ofdmflexframegenprops_s *props_in) {
+
+    props = *props_in;
+    // Make assemble() configure the payload modem.
+    payloadModemLen = 0;
+}
+
+
+void qpacketframegen::assemble(const unsigned char *header,
+        const unsigned char *payload, unsigned int payload_len) {
+
+    ASSERT(payload_len > 0 && payload_len <= 0xFFFF);
+
+    unsigned char h[QPACKETFRAME_H_LEN];
+    memcpy(h, header, HEADER_LEN);
+    h[HEADER_LEN+0] = QPACKETFRAME_PROTOCOL;
+    h[HEADER_LEN+1] = (payload_len >> 8) & 0xFF;
+    h[HEADER_LEN+2] = payload_len & 0xFF;
+    h[HEADER_LEN+3] = props.mod_scheme;
+    h[HEADER_LEN+4] = (props.check & 0x07) << 5 | (props.fec0 & 0x1F);
+    h[HEADER_LEN+5] = props.fec1 & 0x1F;
+
+    if(payloadModemLen != payload_len) {
+        qpacketmodem_configure(payloadModem, payload_len,
+                (crc_scheme) props.check, (fec_scheme) props.fec0,
+                (fec_scheme) props.fec1, props.mod_scheme);
+        payloadModemLen = payload_len;
+    }
+
+    unsigned int numHeaderSyms = qpacketmodem_get_frame_len(headerModem);
+    unsigned int numPayloadSyms = qpacketmodem_get_frame_len(payloadModem);
+    unsigned int numSyms = numHeaderSyms + numPayloadSyms;
+
+    // The symbols padded with zeros to a whole number of OFDM symbols.
+    unsigned int numOfdmSyms = (numSyms + numData - 1)/numData;
+    std::vector<std::complex<float> > syms(numOfdmSyms*numData, 0.0f);
+    qpacketmodem_encode(headerModem, h, syms.data());
+    qpacketmodem_encode(payloadModem, payload, syms.data() + numHeaderSyms);
+
+    // The preamble, the symbols, and the tail.
+    frame.resize((3 + numOfdmSyms)*(M + cp_len) + taper_len);
+
+    ofdmframegen_reset(fg);
+    std::complex<float> *y = frame.data();
+    ofdmframegen_write_S0a(fg, y);
+    y += M + cp_len;
+    ofdmframegen_write_S0b(fg, y);
+    y += M + cp_len;
+    ofdmframegen_write_S1(fg, y);
+    y += M + cp_len;
+
+    std::vector<std::complex<float> > X(M);
+    const std::complex<float> *s = syms.data();
+    for(unsigned int i = 0; i < numOfdmSyms; ++i) {
+        for(unsigned int j = 0; j < M; ++j)
+            X[j] = (p[j] == OFDMFRAME_SCTYPE_DATA)? *s++ : 0.0f;
+        ofdmframegen_writesymbol(fg, X.data(), y);
+        y += M + cp_len;
+    }
+
+    ofdmframegen_writetail(fg, y);
+    DASSERT(y + taper_len == frame.data() + frame.size());
+
+    numWritten = 0;
+}
+
+
+bool qpacketframegen::write(std::complex<float> *buf, unsigned int len) {
+
+    size_t n = frame.size() - numWritten;
+    if(n > len) n = len;
+
+    memcpy(buf, frame.data() + numWritten, n*sizeof(*buf));
+    if(n < len)
+        memset((void *) (buf + n), 0, (len - n)*sizeof(*buf));
+
+    numWritten += n;
+
+    return numWritten == frame.size();
+}
+
+
+
+int qpacketframesync::symbolCallback(std::complex<float> *X,
+        unsigned char *p, unsigned int M, void *userdata) {
+
+    return ((qpacketframesync *) userdata)->rxSymbol(X);
+}
+
+
+qpacketframesync::qpacketframesync(unsigned int M_in, unsigned int cp_len,
+        unsigned int taper_len, unsigned char *p_in,
+        qpacketframe_callback callback_in, void *userdata_in):
+    M(M_in),
+    callback(callback_in),
+    userdata(userdata_in),
+    payloadLen(0),
+    check(LIQUID_CRC_UNKNOWN),
+    fec0(LIQUID_FEC_UNKNOWN),
+    fec1(LIQUID_FEC_UNKNOWN),
+    mod(LIQUID_MODEM_UNKNOWN),
+    inPayload(false),
+    numSyms(0) {
+
+    p = (unsigned char *) malloc(M);
+    ASSERT(p, "malloc() failed");
+    memcpy(p, p_in, M);
+    ASSERT(countDataSubcarriers(M, p) > 0);
+
+    fs = ofdmframesync_create(M, cp_len, taper_len, p,
+            (ofdmframesync_callback) symbolCallback, this);
+    ASSERT(fs, "ofdmframesync_create() failed");
+
+    headerModem = createHeaderModem();
+    numHeaderSyms = qpacketmodem_get_frame_len(headerModem);
+    headerSyms.resize(numHeaderSyms);
+
+    payloadModem = qpacketmodem_create();
+    ASSERT(payloadModem, "qpacketmodem_create() failed");
+
+    memset(&frame, 0, sizeof(frame));
+}
+
+
+qpacketframesync::~qpacketframesync() {
+
+    qpacketmodem_destroy(payloadModem);
+    qpacketmodem_destroy(headerModem);
+    ofdmframesync_destroy(fs);
+    free(p);
+}
+
+
+void qpacketframesync::execute(std::complex<float> *x, unsigned int n) {
+
+    ofdmframesync_execute(fs, x, n);
+}
+
+
+void qpacketframesync::reset(void) {
+
+    ofdmframesync_reset(fs);
+    inPayload = false;
+    numSyms = 0;
+}
+
+
+// Called from ofdmframesync_execute() with each received OFDM symbol
+// after the preamble.  Returns non-zero to make ofdmframesync reset and
+// look for the next frame.
+//
+int qpacketframesync::rxSymbol(std::complex<float> *X) {
+
+    for(unsigned int i = 0; i < M; ++i) {
+
+        if(p[i] != OFDMFRAME_SCTYPE_DATA) continue;
+
+        if(!inPayload) {
+            headerSyms[numSyms++] = X[i];
+            if(numSyms < numHeaderSyms) continue;
+
+            decodeHeader();
+            if(!frame.header_valid) {
+                callback(&frame, userdata);
+                inPayload = false;
+                numSyms = 0;
+                return 1;
+            }
+            inPayload = true;
+            numSyms = 0;
+            continue;
+        }
+
+        payloadSyms[numSyms++] = X[i];
+        if(numSyms < payloadSyms.size()) continue;
+
+        // We have the whole payload.  The rest of this OFDM symbol is
+        // padding.
+        frame.syms = payloadSyms.data();
+        frame.num_syms = payloadSyms.size();
+        callback(&frame, userdata);
+        inPayload = false;
+        numSyms = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+void qpacketframesync::decodeHeader(void) {
+
+    unsigned char h[QPACKETFRAME_H_LEN];
+
+    frame.header_valid = qpacketmodem_decode(headerModem,
+            headerSyms.data(), h);
+    frame.syms = 0;
+    frame.num_syms = 0;
+    frame.rssi = ofdmframesync_get_rssi(fs);
+    frame.cfo = ofdmframesync_get_cfo(fs);
+
+    if(!frame.header_valid) return;
+
+    memcpy(frame.header, h, HEADER_LEN);
+    frame.payload_len = (h[HEADER_LEN+1] << 8) | h[HEADER_LEN+2];
+    frame.mod = (modulation_scheme) h[HEADER_LEN+3];
+    frame.check = (crc_scheme) ((h[HEADER_LEN+4] >> 5) & 0x07);
+    frame.fec0 = (fec_scheme) (h[HEADER_LEN+4] & 0x1F);
+    frame.fec1 = (fec_scheme) (h[HEADER_LEN+5] & 0x1F);
+
+    if(h[HEADER_LEN] != QPACKETFRAME_PROTOCOL ||
+            frame.payload_len == 0 ||
+            frame.mod <= LIQUID_MODEM_UNKNOWN ||
+            frame.mod >= LIQUID_MODEM_NUM_SCHEMES ||
+            frame.check <= LIQUID_CRC_UNKNOWN ||
+            frame.check >= LIQUID_CRC_NUM_SCHEMES ||
+            frame.fec0 <= LIQUID_FEC_UNKNOWN ||
+            frame.fec0 >= LIQUID_FEC_NUM_SCHEMES ||
+            frame.fec1 <= LIQUID_FEC_UNKNOWN ||
+            frame.fec1 >= LIQUID_FEC_NUM_SCHEMES) {
+        // It passed the CRC but it's not one of ours.
+        frame.header_valid = 0;
+        return;
+    }
+
+    if(frame.payload_len != payloadLen || frame.check != check ||
+            frame.fec0 != fec0 || frame.fec1 != fec1 || frame.mod != mod) {
+        payloadLen = frame.payload_len;
+        check = frame.check;
+        fec0 = frame.fec0;
+        fec1 = frame.fec1;
+        mod = frame.mod;
+        qpacketmodem_configure(payloadModem, payloadLen, check,
+                fec0, fec1, mod);
+    }
+
+    payloadSyms.resize(qpacketmodem_get_frame_len(payloadModem));
+}
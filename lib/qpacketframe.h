@@ -0,0 +1,168 @@
+#ifndef __qpacketframe_h__
+#define __qpacketframe_h__
+
+#include <stdint.h>
+
+#include <complex>
+#include <vector>
+
+#include <liquid.h>
+
+#include "common.h"
+
+
+// qpacketframe frames are like liquid ofdmflexframe frames: there are
+// the liquid ofdmframegen S0a, S0b, and S1 preamble symbols, then OFDM
+// symbols that carry a header and then the payload, and then a tail.
+// The header and the payload are each encoded with a liquid qpacketmodem
+// and they are packed one after the other into the data subcarriers.
+//
+// We have these, and not just liquid's ofdmflexframesync, because
+// qpacketframesync gives us the received payload symbols before they are
+// decoded.  So we can do the demodulation and FEC decoding on other
+// threads (see pipeline.h), and whatever else we like with the symbols.
+//
+// These are not compatible with liquid ofdmflexframe frames.
+
+
+// The header is the HEADER_LEN byte user header from common.h then:
+//
+//   [0]    QPACKETFRAME_PROTOCOL
+//   [1-2]  payload length, big endian
+//   [3]    payload modulation_scheme
+//   [4]    payload crc_scheme << 5 | payload fec0
+//   [5]    payload fec1
+//
+#define QPACKETFRAME_PROTOCOL  (0x71)
+#define QPACKETFRAME_H_LEN     (HEADER_LEN + 6)
+#define QPACKETFRAME_H_CRC     (LIQUID_CRC_32)
+#define QPACKETFRAME_H_FEC0    (LIQUID_FEC_GOLAY2412)
+#define QPACKETFRAME_H_FEC1    (LIQUID_FEC_NONE)
+#define QPACKETFRAME_H_MOD     (LIQUID_MODEM_BPSK)
+
+
+// What qpacketframesync gives its callback for each frame it finds.
+struct qpacketframe {
+
+    int header_valid;
+    unsigned char header[HEADER_LEN];
+
+    // Payload properties from the header
+    unsigned int payload_len;
+    crc_scheme check;
+    fec_scheme fec0;
+    fec_scheme fec1;
+    modulation_scheme mod;
+
+    // The received payload symbols, equalized.  Empty if the header is
+    // not valid.
+    std::complex<float> *syms;
+    unsigned int num_syms;
+
+    float rssi;
+    float cfo;
+};
+
+
+typedef void (*qpacketframe_callback)(struct qpacketframe *frame,
+        void *userdata);
+
+
+class qpacketframegen {
+
+    public:
+
+        // p is the subcarrier allocation, like ofdmflexframegen_create()
+        qpacketframegen(unsigned int M, unsigned int cp_len,
+                unsigned int taper_len, unsigned char *p,
+                const ofdmflexframegenprops_s *props);
+        ~qpacketframegen();
+
+        void setprops(const ofdmflexframegenprops_s *props);
+
+        // Like ofdmflexframegen_assemble()
+        void assemble(const unsigned char *header,
+                const unsigned char *payload, unsigned int payload_len);
+
+        // Like ofdmflexframegen_write(), returns true when the last
+        // sample of the frame has been written.  The rest of buf after
+        // the end of the frame is zeros.
+        bool write(std::complex<float> *buf, unsigned int len);
+
+        // The number of samples in the frame last assembled.
+        size_t frame_len(void) const { return frame.size(); }
+
+    private:
+
+        unsigned int M;
+        unsigned int cp_len;
+        unsigned int taper_len;
+        unsigned char *p;
+        unsigned int numData;
+
+        ofdmflexframegenprops_s props;
+
+        ofdmframegen fg;
+        qpacketmodem headerModem;
+        qpacketmodem payloadModem;
+        unsigned int payloadModemLen;
+
+        // The whole frame, and how much of it write() has written.
+        std::vector<std::complex<float> > frame;
+        size_t numWritten;
+};
+
+
+class qpacketframesync {
+
+    public:
+
+        qpacketframesync(unsigned int M, unsigned int cp_len,
+                unsigned int taper_len, unsigned char *p,
+                qpacketframe_callback callback, void *userdata);
+        ~qpacketframesync();
+
+        void execute(std::complex<float> *x, unsigned int n);
+        void reset(void);
+
+        // This needs to be a C function that is in effect part of this
+        // object.
+        static int symbolCallback(std::complex<float> *X,
+                unsigned char *p, unsigned int M, void *userdata);
+
+    private:
+
+        int rxSymbol(std::complex<float> *X);
+        void decodeHeader(void);
+
+        unsigned int M;
+        unsigned char *p;
+
+        qpacketframe_callback callback;
+        void *userdata;
+
+        ofdmframesync fs;
+        qpacketmodem headerModem;
+        unsigned int numHeaderSyms;
+
+        // We only use this to get the number of payload symbols, so we
+        // only configure it when the payload properties change.
+        qpacketmodem payloadModem;
+        unsigned int payloadLen;
+        crc_scheme check;
+        fec_scheme fec0;
+        fec_scheme fec1;
+        modulation_scheme mod;
+
+        // We are receiving the header, then the payload.
+        bool inPayload;
+
+        std::vector<std::complex<float> > headerSyms;
+        std::vector<std::complex<float> > payloadSyms;
+        size_t numSyms;
+
+        struct qpacketframe frame;
+};
+
+
+#endif // #ifndef __qpacketframe_h__
@@ -17,3 +17,7 @@ except ImportError:
 
 # import any pure python here
 #
+try:
+    from .batch import encode, decode, STATS_DTYPE
+except ImportError:
+    pass
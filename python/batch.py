@@ -0,0 +1,91 @@
+'''
+Offline batch encoding and decoding of liquid ofdmflexframe frames, with
+numpy arrays and without a flowgraph.
+
+The work is done by liquidDSP.ofdmflexframebatch in C++ threads that run
+without the python GIL.  Samples are passed to and from C++ by the
+address of the numpy array buffers, so they are not copied.
+'''
+
+from __future__ import unicode_literals
+
+import numpy
+
+from .liquidDSP_swig import ofdmflexframebatch
+
+
+# This must be the same as struct batch_frame_stats in
+# lib/ofdmflexframebatch.h
+STATS_DTYPE = numpy.dtype([
+    ('sample', numpy.uint64),
+    ('payload_offset', numpy.uint64),
+    ('frame_count', numpy.uint64),
+    ('payload_len', numpy.uint32),
+    ('stream_id', numpy.uint32),
+    ('header_valid', numpy.int32),
+    ('payload_valid', numpy.int32),
+    ('evm', numpy.float32),
+    ('rssi', numpy.float32),
+    ('cfo', numpy.float32),
+    ('mod_scheme', numpy.int32)], align=True)
+
+
+SAMPLE_FORMATS = {
+    'cf32': ofdmflexframebatch.CF32,
+    'sc16': ofdmflexframebatch.SC16
+}
+
+
+def encode(payloads, mcs=5, nthreads=0, mcs_table='', subcarriers=''):
+    '''
+    Encode a list of payloads (bytes like objects) into frames with
+    modulation code scheme mcs from mcs_table (see lib/mcs.h) and the
+    subcarrier allocation subcarriers (see lib/numerology.h).  Returns a
+    numpy complex64 array with all the frames one after the other.
+    '''
+    b = ofdmflexframebatch(nthreads, 1 << 16, mcs_table, subcarriers)
+    data = numpy.frombuffer(b''.join(payloads), dtype=numpy.uint8)
+    lens = numpy.array([len(p) for p in payloads], dtype=numpy.uint32)
+
+    n = b.encode_length_buffer(lens.ctypes.data, len(lens), mcs)
+    out = numpy.empty(n, dtype=numpy.complex64)
+    b.encode_buffer(data.ctypes.data, lens.ctypes.data, len(lens), mcs,
+            out.ctypes.data, n)
+    return out
+
+
+def decode(samples, sample_format='cf32', nthreads=0, overlap=1 << 16,
+        subcarriers=''):
+    '''
+    Decode the frames in samples, a numpy complex64 array for 'cf32' or
+    a numpy int16 array of interleaved I and Q for 'sc16', sent with the
+    subcarrier allocation subcarriers.
+
+    Returns (payloads, stats, frames) where payloads is a numpy uint8
+    array of all the payloads one after the other, stats is a numpy
+    array of STATS_DTYPE with one entry per frame, and frames is a list
+    of numpy views of the payload of each frame.
+    '''
+    fmt = SAMPLE_FORMATS[sample_format]
+    if fmt == ofdmflexframebatch.SC16:
+        samples = numpy.ascontiguousarray(samples, dtype=numpy.int16)
+        num_samples = len(samples)//2
+    else:
+        samples = numpy.ascontiguousarray(samples, dtype=numpy.complex64)
+        num_samples = len(samples)
+
+    assert ofdmflexframebatch.stats_item_size() == STATS_DTYPE.itemsize
+
+    b = ofdmflexframebatch(nthreads, overlap, '', subcarriers)
+    b.decode_buffer(samples.ctypes.data, num_samples, fmt)
+
+    payloads = numpy.empty(b.payloads_size(), dtype=numpy.uint8)
+    stats = numpy.empty(b.stats_size(), dtype=STATS_DTYPE)
+    b.copy_payloads(payloads.ctypes.data)
+    b.copy_stats(stats.ctypes.data)
+
+    frames = [payloads[s['payload_offset']:
+                       s['payload_offset'] + s['payload_len']]
+              for s in stats]
+
+    return payloads, stats, frames
@@ -8,6 +8,7 @@
 %{
 #include "ofdmflexframegen.h"
 #include "ofdmflexframesync.h"
+#include "ofdmflexframebatch.h"
 %}
 
 %include "ofdmflexframegen.h"
@@ -16,3 +17,12 @@ GR_SWIG_BLOCK_MAGIC2(liquidDSP, ofdmflexframegen);
 %include "ofdmflexframesync.h"
 GR_SWIG_BLOCK_MAGIC2(liquidDSP, ofdmflexframesync);
 
+
+// python gets buffer address versions of these; see python/batch.py.
+%ignore gr::liquidDSP::batch_frame_stats;
+%ignore gr::liquidDSP::ofdmflexframebatch::encode_length;
+%ignore gr::liquidDSP::ofdmflexframebatch::encode;
+%ignore gr::liquidDSP::ofdmflexframebatch::decode;
+%ignore gr::liquidDSP::ofdmflexframebatch::payloads;
+%ignore gr::liquidDSP::ofdmflexframebatch::stats;
+%include "ofdmflexframebatch.h"